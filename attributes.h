@@ -0,0 +1,226 @@
+#pragma once
+
+#include "coords.h"
+#include "itemtype.h"
+#include "schema.h"
+#include "stream.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+namespace otbm {
+
+enum {
+  ATTR_DESCRIPTION = 1,
+  ATTR_EXT_FILE = 2,
+  ATTR_TILE_FLAGS = 3,
+  ATTR_ACTION_ID = 4,
+  ATTR_UNIQUE_ID = 5,
+  ATTR_TEXT = 6,
+  ATTR_DESC = 7,
+  ATTR_TELE_DEST = 8,
+  ATTR_ITEM = 9,
+  ATTR_DEPOT_ID = 10,
+  ATTR_EXT_SPAWN_FILE = 11,
+  ATTR_RUNE_CHARGES = 12,
+  ATTR_EXT_HOUSE_FILE = 13,
+  ATTR_HOUSEDOORID = 14,
+  ATTR_COUNT = 15,
+  ATTR_DURATION = 16,
+  ATTR_DECAYING_STATE = 17,
+  ATTR_WRITTENDATE = 18,
+  ATTR_WRITTENBY = 19,
+  ATTR_SLEEPERGUID = 20,
+  ATTR_SLEEPSTART = 21,
+  ATTR_CHARGES = 22,
+  ATTR_CONTAINER_ITEMS = 23,
+  ATTR_NAME = 24,
+  ATTR_ARTICLE = 25,
+  ATTR_PLURALNAME = 26,
+  ATTR_WEIGHT = 27,
+  ATTR_ATTACK = 28,
+  ATTR_DEFENSE = 29,
+  ATTR_EXTRADEFENSE = 30,
+  ATTR_ARMOR = 31,
+  ATTR_HITCHANCE = 32,
+  ATTR_SHOOTRANGE = 33,
+  ATTR_CUSTOM_ATTRIBUTES = 34,
+  ATTR_DECAYTO = 35,
+  ATTR_WRAPID = 36,
+  ATTR_STOREITEM = 37
+};
+
+enum {
+  NODETYPE_ROOTV1 = 1,
+  NODETYPE_MAP_DATA = 2,
+  NODETYPE_ITEM_DEF = 3,
+  NODETYPE_TILE_AREA = 4,
+  NODETYPE_TILE = 5,
+  NODETYPE_ITEM = 6,
+  NODETYPE_TILE_SQUARE = 7,
+  NODETYPE_TILE_REF = 8,
+  NODETYPE_SPAWNS = 9,
+  NODETYPE_SPAWN_AREA = 10,
+  NODETYPE_MONSTER = 11,
+  NODETYPE_TOWNS = 12,
+  NODETYPE_TOWN = 13,
+  NODETYPE_HOUSETILE = 14,
+  NODETYPE_WAYPOINTS = 15,
+  NODETYPE_WAYPOINT = 16,
+};
+
+enum {
+  TILEFLAG_PROTECTIONZONE = 1 << 0,
+  TILEFLAG_NOPVPZONE = 1 << 2,
+  TILEFLAG_NOLOGOUT = 1 << 3,
+  TILEFLAG_PVPZONE = 1 << 4,
+};
+
+// Positions are stored as x and y on 2 bytes each, then the floor on 1.
+inline Coords read_coords(otb::iterator &first, const otb::iterator &last) {
+  auto x = read<uint16_t>(first, last);
+  auto y = read<uint16_t>(first, last);
+  auto z = read<uint8_t>(first, last);
+  return {x, y, z};
+}
+
+inline bool try_read_coords(otb::iterator &first, const otb::iterator &last, Coords &coords) {
+  return try_read(first, last, coords.x) and try_read(first, last, coords.y) and try_read(first, last, coords.z);
+}
+
+namespace detail {
+
+inline bool decode_subtype(otb::Item &item, otb::iterator &first, const otb::iterator &last, uint16_t) {
+  auto subtype = uint8_t{0};
+  if (not try_read(first, last, subtype)) {
+    return false;
+  }
+  item.subtype(subtype);
+  return true;
+}
+
+inline bool decode_duration(otb::Item &item, otb::iterator &first, const otb::iterator &last, uint16_t) {
+  auto duration = int32_t{0};
+  if (not try_read(first, last, duration)) {
+    return false;
+  }
+  item.duration = std::max<int32_t>(0, duration);
+  return true;
+}
+
+template <bool Store> bool custom_attributes(otb::Item *item, otb::iterator &first, const otb::iterator &last) {
+  auto count = uint64_t{0};
+  if (not try_read(first, last, count)) {
+    return false;
+  }
+
+  auto key = std::string{};
+  for (uint64_t i = 0; i < count; ++i) {
+    auto key_len = uint16_t{0};
+    auto type = uint8_t{0};
+    if (not try_read(first, last, key_len) or not try_read_string(first, last, key_len, key) or not try_read(first, last, type)) {
+      return false;
+    }
+
+    auto val = otb::Item::attribute{};
+    auto ok = true;
+    switch (type) {
+    case 1: {
+      auto val_len = uint16_t{0};
+      auto text = std::string{};
+      ok = try_read(first, last, val_len) and try_read_string(first, last, val_len, text);
+      val = std::move(text);
+      break;
+    }
+
+    case 2: {
+      auto number = int64_t{0};
+      ok = try_read(first, last, number);
+      val = number;
+      break;
+    }
+
+    case 3: {
+      auto number = 0.0;
+      ok = try_read(first, last, number);
+      val = number;
+      break;
+    }
+
+    case 4: {
+      auto flag = false;
+      ok = try_read(first, last, flag);
+      val = flag;
+      break;
+    }
+    }
+    if (not ok) {
+      return false;
+    }
+
+    if constexpr (Store) {
+      item->custom_attributes.emplace(std::move(key), std::move(val));
+    }
+  }
+  return true;
+}
+
+inline bool decode_custom_attributes(otb::Item &item, otb::iterator &first, const otb::iterator &last, uint16_t) {
+  return custom_attributes<true>(&item, first, last);
+}
+
+inline bool skip_custom_attributes(otb::iterator &first, const otb::iterator &last, uint16_t) { return custom_attributes<false>(nullptr, first, last); }
+
+inline bool skip_subtype(otb::iterator &first, const otb::iterator &last, uint16_t) { return try_skip(first, last, sizeof(uint8_t)); }
+
+inline bool skip_duration(otb::iterator &first, const otb::iterator &last, uint16_t) { return try_skip(first, last, sizeof(int32_t)); }
+
+} // namespace detail
+
+// Attributes of an item node in an OTBM map.
+namespace item_schema {
+
+using namespace otb::schema;
+using otb::Item;
+
+using decoder = otb::schema::decoder<framing::INLINE, Item,
+                                     custom<ATTR_COUNT, detail::decode_subtype, detail::skip_subtype>,
+                                     custom<ATTR_CHARGES, detail::decode_subtype, detail::skip_subtype>,
+                                     custom<ATTR_RUNE_CHARGES, detail::decode_subtype, detail::skip_subtype>,
+                                     value<ATTR_ACTION_ID, &Item::action_id>,
+                                     value<ATTR_UNIQUE_ID, &Item::unique_id>,
+                                     string<ATTR_TEXT, &Item::text>,
+                                     value<ATTR_WRITTENDATE, &Item::written_at>,
+                                     string<ATTR_WRITTENBY, &Item::writer>,
+                                     string<ATTR_DESC, &Item::description>,
+                                     custom<ATTR_DURATION, detail::decode_duration, detail::skip_duration>,
+                                     ignore<ATTR_DECAYING_STATE, 1>, // TODO
+                                     string<ATTR_NAME, &Item::name>,
+                                     string<ATTR_ARTICLE, &Item::article>,
+                                     string<ATTR_PLURALNAME, &Item::plural_name>,
+                                     value<ATTR_WEIGHT, &Item::weight>,
+                                     value<ATTR_ATTACK, &Item::attack>,
+                                     value<ATTR_DEFENSE, &Item::defense>,
+                                     value<ATTR_EXTRADEFENSE, &Item::extra_defense>,
+                                     value<ATTR_ARMOR, &Item::armor>,
+                                     value<ATTR_HITCHANCE, &Item::hit_chance>,
+                                     value<ATTR_SHOOTRANGE, &Item::shoot_range>,
+                                     value<ATTR_DECAYTO, &Item::decay_to>,
+                                     value<ATTR_WRAPID, &Item::wrap_id>,
+                                     value<ATTR_STOREITEM, &Item::store_item>,
+                                     // these should be handled through derived classes
+                                     // if these are called then something has changed in the items.xml since the map was saved
+                                     // just read the values
+                                     ignore<ATTR_DEPOT_ID, 2>,
+                                     ignore<ATTR_HOUSEDOORID, 1>,
+                                     ignore<ATTR_SLEEPERGUID, 4>,
+                                     ignore<ATTR_SLEEPSTART, 4>,
+                                     ignore<ATTR_TELE_DEST, 5>,
+                                     // item count of the container; the items themselves are child nodes
+                                     ignore<ATTR_CONTAINER_ITEMS, 4>,
+                                     custom<ATTR_CUSTOM_ATTRIBUTES, detail::decode_custom_attributes, detail::skip_custom_attributes>>;
+
+} // namespace item_schema
+
+} // namespace otbm
@@ -0,0 +1,987 @@
+#include "attributes.h"
+#include "concurrent.h"
+#include "otbi.h"
+#include "otbm.h"
+#include "parallel.h"
+#include "pathfinding.h"
+#include "sight.h"
+#include "stream.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <sys/resource.h>
+#include <thread>
+
+// Every allocation made through operator new is counted, so benchmarks can check code that should not allocate.
+namespace {
+std::atomic<uint64_t> allocation_count{0};
+uint64_t allocations() { return allocation_count.load(std::memory_order_relaxed); }
+} // namespace
+
+void *operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (auto pointer = std::malloc(size ? size : 1)) {
+    return pointer;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+double elapsed_ms(clock_type::time_point since) { return std::chrono::duration<double, std::milli>(clock_type::now() - since).count(); }
+
+void print_stats(std::string_view name, const otb::LoadStats &stats) {
+  auto phase = [](std::string_view phase, const otb::PhaseTime &time) { fmt::print("  {:<10s} {:9.1f} ms wall {:9.1f} ms cpu\n", phase, time.wall_ms, time.cpu_ms); };
+
+  fmt::print("{:s}:\n", name);
+  phase("map file", stats.map_file);
+  phase("tree scan", stats.tree_scan);
+  phase("count", stats.count);
+  phase("decode", stats.decode);
+  phase("insertion", stats.insertion);
+  phase("external", stats.external);
+  fmt::print("  {:d} bytes scanned, {:d} escapes, {:d} nodes, {:d} tiles, {:d} items\n", stats.bytes_scanned, stats.escape_bytes, stats.nodes, stats.tiles,
+             stats.items);
+  fmt::print("  {:d} houses, {:d} spawns\n", stats.houses, stats.spawns);
+  fmt::print("  {:d} rehashes, {:d} reallocations\n", stats.rehashes, stats.reallocations);
+  fmt::print("  heap {:+d} bytes in {:d} allocations, peak rss {:d} bytes\n", stats.heap_bytes, stats.allocations, stats.peak_rss);
+}
+
+// The hand-written switch the schema decoder replaced, kept as a baseline.
+bool decode_switch(uint8_t attr, otb::Item &item, otb::iterator &first, const otb::iterator &last) {
+  using namespace otbm;
+
+  switch (attr) {
+  case ATTR_CHARGES:
+  case ATTR_COUNT:
+  case ATTR_RUNE_CHARGES:
+    item.subtype(read<uint8_t>(first, last));
+    return true;
+  case ATTR_ACTION_ID:
+    item.action_id = read<uint16_t>(first, last);
+    return true;
+  case ATTR_UNIQUE_ID:
+    item.unique_id = read<uint16_t>(first, last);
+    return true;
+  case ATTR_TEXT: {
+    auto len = read<uint16_t>(first, last);
+    item.text = read_string(first, last, len);
+    return true;
+  }
+  case ATTR_WRITTENDATE:
+    item.written_at = read<uint32_t>(first, last);
+    return true;
+  case ATTR_DURATION:
+    item.duration = std::max<int32_t>(0, read<int32_t>(first, last));
+    return true;
+  case ATTR_WEIGHT:
+    item.weight = read<uint32_t>(first, last);
+    return true;
+  case ATTR_ATTACK:
+    item.attack = read<int32_t>(first, last);
+    return true;
+  case ATTR_DEFENSE:
+    item.defense = read<int32_t>(first, last);
+    return true;
+  case ATTR_HITCHANCE:
+    item.hit_chance = read<uint8_t>(first, last);
+    return true;
+  case ATTR_DECAYTO:
+    item.decay_to = read<int32_t>(first, last);
+    return true;
+  case ATTR_WRAPID:
+    item.wrap_id = read<uint16_t>(first, last);
+    return true;
+  case ATTR_DEPOT_ID:
+    skip(first, last, 2);
+    return true;
+  case ATTR_TELE_DEST:
+    skip(first, last, 5);
+    return true;
+  default:
+    return false;
+  }
+}
+
+int attributes(int argc, char **argv) {
+  auto records = argc > 0 ? std::strtoul(argv[0], nullptr, 10) : 1000000;
+
+  // A stream of item attribute sets as found on map items, with the occasional escaped byte.
+  std::string buffer;
+  auto put = [&](auto value) {
+    auto bytes = reinterpret_cast<const char *>(&value);
+    for (size_t i = 0; i < sizeof(value); ++i) {
+      if (bytes[i] == otb::detail::ESCAPE or bytes[i] == otb::detail::START or bytes[i] == otb::detail::END) {
+        buffer.push_back(otb::detail::ESCAPE);
+      }
+      buffer.push_back(bytes[i]);
+    }
+  };
+  auto rng = std::mt19937{42};
+  for (size_t i = 0; i < records; ++i) {
+    switch (i % 6) {
+    case 0:
+      put(uint8_t{otbm::ATTR_ACTION_ID}), put(static_cast<uint16_t>(rng()));
+      break;
+    case 1:
+      put(uint8_t{otbm::ATTR_UNIQUE_ID}), put(static_cast<uint16_t>(rng()));
+      break;
+    case 2:
+      put(uint8_t{otbm::ATTR_COUNT}), put(static_cast<uint8_t>(rng()));
+      break;
+    case 3:
+      put(uint8_t{otbm::ATTR_TEXT}), put(uint16_t{12}), buffer.append("a short text");
+      break;
+    case 4:
+      put(uint8_t{otbm::ATTR_WRITTENDATE}), put(static_cast<uint32_t>(rng()));
+      break;
+    case 5:
+      put(uint8_t{otbm::ATTR_ATTACK}), put(static_cast<int32_t>(rng()));
+      break;
+    }
+  }
+
+  auto type = otb::ItemType{"", "", 0, 0, 100, 100, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, otb::item_group::NONE, otb::item_type::NONE};
+  auto run = [&](auto &&decode) {
+    auto item = otb::Item{&type};
+    uint64_t checksum = 0;
+    auto first = static_cast<otb::iterator>(buffer.data());
+    auto last = first + buffer.size();
+    auto start = clock_type::now();
+    while (first != last) {
+      if (not decode(read<uint8_t>(first, last), item, first, last)) {
+        throw std::logic_error("Unknown attribute in benchmark data.");
+      }
+      checksum += item.action_id + item.unique_id + item.count + item.written_at + item.text.size();
+    }
+    auto ms = elapsed_ms(start);
+    return std::make_pair(ms, checksum);
+  };
+
+  for (int round = 0; round < 3; ++round) {
+    auto [switch_ms, switch_sum] = run(decode_switch);
+    auto [schema_ms, schema_sum] = run([](uint8_t attr, otb::Item &item, otb::iterator &first, const otb::iterator &last) {
+      return otbm::item_schema::decoder::decode(attr, item, first, last) == otb::schema::result::DECODED;
+    });
+    if (switch_sum != schema_sum) {
+      fmt::print("Decoders disagree.\n");
+      return 1;
+    }
+    fmt::print("{:d} attributes ({:d} bytes): switch {:.1f} ms, schema {:.1f} ms.\n", records, buffer.size(), switch_ms, schema_ms);
+  }
+  return 0;
+}
+
+int load(int argc, char **argv) {
+  if (argc < 2) {
+    fmt::print("usage: bench load <items.otb> <map.otbm> [lenient]\n");
+    return 1;
+  }
+
+  auto items_stats = otb::LoadStats{};
+  items_stats.allocation_counter = allocations;
+  auto items_options = otbi::LoadOptions{};
+  items_options.stats = &items_stats;
+  auto items = otbi::load(argv[0], items_options);
+  print_stats("items", items_stats);
+
+  auto map_stats = otb::LoadStats{};
+  map_stats.allocation_counter = allocations;
+  auto map_options = otbm::LoadOptions{};
+  map_options.stats = &map_stats;
+  map_options.lenient = argc > 2 and std::string_view{argv[2]} == "lenient";
+  auto map = otbm::load(argv[1], items, map_options);
+  print_stats("map", map_stats);
+  return 0;
+}
+
+int presize(int argc, char **argv) {
+  if (argc < 2) {
+    fmt::print("usage: bench presize <items.otb> <map.otbm>\n");
+    return 1;
+  }
+
+  auto items = otbi::load(argv[0]);
+  for (auto presize : {false, true}) {
+    auto stats = otb::LoadStats{};
+    stats.allocation_counter = allocations;
+    auto options = otbm::LoadOptions{};
+    options.stats = &stats;
+    options.presize = presize;
+    otbm::load(argv[1], items, options);
+    print_stats(presize ? "presized" : "growing", stats);
+  }
+  return 0;
+}
+
+// Writes a map of `areas` full tile areas, where every other tile holds a few bare items on top of its ground: one inline, like grounds,
+// and two as item nodes without attributes.
+void write_plain_map(const std::string &filename, size_t areas, uint16_t ground, uint16_t item) {
+  std::string out{"OTBM"};
+  auto byte = [&](uint8_t value) {
+    auto c = static_cast<char>(value);
+    if (c == otb::detail::ESCAPE or c == otb::detail::START or c == otb::detail::END) {
+      out.push_back(otb::detail::ESCAPE);
+    }
+    out.push_back(c);
+  };
+  auto u16 = [&](uint16_t value) {
+    byte(static_cast<uint8_t>(value));
+    byte(static_cast<uint8_t>(value >> 8));
+  };
+  auto u32 = [&](uint32_t value) {
+    u16(static_cast<uint16_t>(value));
+    u16(static_cast<uint16_t>(value >> 16));
+  };
+  auto start = [&](uint8_t type) {
+    out.push_back(otb::detail::START);
+    byte(type);
+  };
+  auto end = [&] { out.push_back(otb::detail::END); };
+
+  start(0);
+  u32(2);
+  u16(static_cast<uint16_t>(areas * 256));
+  u16(256);
+  u32(3);
+  u32(57);
+  start(otbm::NODETYPE_MAP_DATA);
+  for (size_t area = 0; area < areas; ++area) {
+    start(otbm::NODETYPE_TILE_AREA);
+    u16(static_cast<uint16_t>(area * 256));
+    u16(0);
+    byte(7);
+    for (unsigned x = 0; x < 256; ++x) {
+      for (unsigned y = 0; y < 256; ++y) {
+        start(otbm::NODETYPE_TILE);
+        byte(static_cast<uint8_t>(x));
+        byte(static_cast<uint8_t>(y));
+        byte(otbm::ATTR_ITEM);
+        u16(ground);
+        if ((x + y) % 2 == 0) {
+          byte(otbm::ATTR_ITEM);
+          u16(item);
+          for (auto i = 0; i < 2; ++i) {
+            start(otbm::NODETYPE_ITEM);
+            u16(item);
+            end();
+          }
+        }
+        end();
+      }
+    }
+    end();
+  }
+  end();
+  end();
+
+  std::ofstream{filename, std::ios::binary}.write(out.data(), static_cast<std::streamsize>(out.size()));
+}
+
+// Decoding a tile must not allocate beyond the item vector it keeps, which is presized to hold every item at once. Tiles are streamed through
+// a visitor without being kept, so the allocations between areas are those of decoding the next area. Fails when any area makes more.
+int allocations(int argc, char **argv) {
+  if (argc < 1) {
+    fmt::print("usage: bench allocations <items.otb> [areas]\n");
+    return 1;
+  }
+  auto areas = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 8;
+
+  auto items = otbi::load(argv[0]);
+  auto ground = std::find_if(items.begin(), items.end(), [](const otb::ItemType &type) { return type.is_ground_tile(); });
+  auto item = std::find_if(items.begin(), items.end(), [](const otb::ItemType &type) { return not type.is_ground_tile() and not type.is_container(); });
+  if (ground == items.end() or item == items.end()) {
+    fmt::print("{:s} needs a ground and a plain item type.\n", argv[0]);
+    return 1;
+  }
+
+  auto filename = (std::filesystem::temp_directory_path() / "bench-allocations.otbm").string();
+  write_plain_map(filename, areas, ground->id(), item->id());
+
+  auto failed = false;
+  for (auto presize : {false, true}) {
+    // Allocation counts when each area's first tile is visited, and tiles with items per area.
+    std::vector<uint64_t> counts;
+    std::vector<uint64_t> holding;
+    counts.reserve(areas);
+    holding.reserve(areas);
+    auto options = otbm::LoadOptions{};
+    options.keep_tiles = false;
+    options.presize = presize;
+    options.tile_visitor = [&](const otbm::Coords &coords, const otbm::Tile &tile) {
+      if (coords.x % 256 == 0 and coords.y == 0) {
+        counts.push_back(allocations());
+        holding.push_back(0);
+      }
+      holding.back() += not tile.items().empty();
+    };
+    otbm::load(filename, items, options);
+
+    // The first area also sets up the decoder's scratch buffers.
+    fmt::print("{:s}:\n", presize ? "presized" : "growing");
+    for (size_t area = 1; area < counts.size(); ++area) {
+      auto made = counts[area] - counts[area - 1];
+      fmt::print("  area {:3d}: {:7d} allocations for {:7d} tiles holding items\n", area, made, holding[area]);
+      failed |= presize and made != holding[area];
+    }
+  }
+
+  std::filesystem::remove(filename);
+  if (failed) {
+    fmt::print("Tile decoding allocated more than the presized item vectors.\n");
+  }
+  return failed ? 1 : 0;
+}
+
+int items(int argc, char **argv) {
+  if (argc < 1) {
+    fmt::print("usage: bench items <items.otb> [runs]\n");
+    return 1;
+  }
+  auto runs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20;
+
+  fmt::print("{:>7s} {:>12s} {:>12s} {:>12s} {:>12s}\n", "threads", "best ms", "median ms", "decode ms", "tables ms");
+  for (auto threads : {1u, 0u}) {
+    std::vector<double> totals;
+    auto decode = 0.0;
+    auto insertion = 0.0;
+    for (size_t run = 0; run < runs; ++run) {
+      auto stats = otb::LoadStats{};
+      auto options = otbi::LoadOptions{};
+      options.stats = &stats;
+      options.threads = threads;
+
+      auto start = clock_type::now();
+      auto items = otbi::load(argv[0], options);
+      totals.push_back(elapsed_ms(start));
+      decode += stats.decode.wall_ms;
+      insertion += stats.insertion.wall_ms;
+    }
+
+    std::sort(totals.begin(), totals.end());
+    auto average = [runs](double total) { return total / static_cast<double>(runs); };
+    fmt::print("{:>7d} {:12.2f} {:12.2f} {:12.2f} {:12.2f}\n", otb::thread_count(threads), totals.front(), totals[totals.size() / 2], average(decode),
+               average(insertion));
+  }
+  return 0;
+}
+
+// The byte-at-a-time loops the unescape kernel replaced, kept as a baseline.
+std::string read_string_bytewise(otb::iterator &first, const otb::iterator &last, size_t len) {
+  std::string out;
+  out.reserve(len);
+  while (out.size() < len and first < last) {
+    if (*first == otb::detail::ESCAPE and ++first == last) {
+      break;
+    }
+    out.push_back(*first++);
+  }
+  return out;
+}
+
+void skip_bytewise(otb::iterator &first, const otb::iterator &last, size_t len) {
+  for (size_t size = 0; size < len and first < last; ++size) {
+    if (*first == otb::detail::ESCAPE) {
+      ++first;
+    }
+    ++first;
+  }
+}
+
+int unescape(int argc, char **argv) {
+  auto length = argc > 0 ? std::strtoul(argv[0], nullptr, 10) : 256;
+  auto total = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64ul << 20;
+
+  std::mt19937 random{42};
+  for (auto density : {0.0, 0.001, 0.01, 0.1, 0.5}) {
+    // Strings of `length` unescaped bytes, `density` of them escaped, back to back.
+    std::string buffer;
+    auto strings = std::max(total / length, 1ul);
+    std::bernoulli_distribution escaped{density};
+    std::uniform_int_distribution<int> byte{0, 0xFC};
+    for (size_t i = 0; i < strings * length; ++i) {
+      if (escaped(random)) {
+        buffer.push_back(otb::detail::ESCAPE);
+        buffer.push_back(static_cast<char>(0xFD + i % 3));
+      } else {
+        buffer.push_back(static_cast<char>(byte(random)));
+      }
+    }
+
+    size_t checksum = 0;
+    auto measure = [&](auto &&step) {
+      auto start = clock_type::now();
+      otb::iterator first = buffer.data();
+      const otb::iterator last = buffer.data() + buffer.size();
+      for (size_t i = 0; i < strings; ++i) {
+        step(first, last);
+      }
+      checksum += static_cast<size_t>(first - buffer.data());
+      return elapsed_ms(start);
+    };
+
+    auto string_bytewise_ms = measure([&](otb::iterator &first, const otb::iterator &last) { checksum += read_string_bytewise(first, last, length).back(); });
+    auto string_ms = measure([&](otb::iterator &first, const otb::iterator &last) { checksum += read_string(first, last, static_cast<int>(length)).back(); });
+    auto skip_bytewise_ms = measure([&](otb::iterator &first, const otb::iterator &last) { skip_bytewise(first, last, length); });
+    auto skip_ms = measure([&](otb::iterator &first, const otb::iterator &last) { skip(first, last, static_cast<int>(length)); });
+    auto read_ms = measure([&](otb::iterator &first, const otb::iterator &last) {
+      for (size_t i = 0; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        checksum += read<uint64_t>(first, last);
+      }
+      skip(first, last, static_cast<int>(length % sizeof(uint64_t)));
+    });
+
+    fmt::print("{:5.1f}% escaped, {:d} x {:d} bytes: read_string {:.1f} ms (bytewise {:.1f} ms), skip {:.1f} ms (bytewise {:.1f} ms), read<uint64_t> "
+               "{:.1f} ms [{:d}]\n",
+               density * 100, strings, length, string_ms, string_bytewise_ms, skip_ms, skip_bytewise_ms, read_ms, checksum % 10);
+  }
+  return 0;
+}
+
+int io(int argc, char **argv) {
+  if (argc < 1) {
+    fmt::print("usage: bench io <file.otbm> [runs]\n");
+    return 1;
+  }
+
+  auto filename = std::string{argv[0]};
+  auto runs = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 3;
+
+  auto mmap = otb::IoOptions{};
+  auto populate = mmap;
+  populate.populate = true;
+  auto sequential = mmap;
+  sequential.sequential = true;
+  auto huge_pages = sequential;
+  huge_pages.huge_pages = true;
+  auto pread = otb::IoOptions{};
+  pread.strategy = otb::IoStrategy::PREAD;
+  auto pread_huge_pages = pread;
+  pread_huge_pages.huge_pages = true;
+  auto async = otb::IoOptions{};
+  async.strategy = otb::IoStrategy::ASYNC;
+  async.read_size = size_t{1} << 20;
+  async.queue_depth = 16;
+
+  const std::pair<std::string_view, otb::IoOptions> strategies[] = {
+      {"mmap", mmap},          {"mmap populate", populate}, {"mmap sequential", sequential}, {"mmap huge pages", huge_pages},
+      {"pread", pread},        {"pread huge pages", pread_huge_pages}, {"async", async},
+  };
+
+  auto major_faults = [] {
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_majflt;
+  };
+
+  // Reading the file and scanning its tree; decoding is the same for every strategy. ASYNC reads overlap the scan, so compare the totals.
+  for (const auto &[name, io] : strategies) {
+    for (auto cold : {true, false}) {
+      auto stats = otb::LoadStats{};
+      auto options = otb::LoadOptions{};
+      options.stats = &stats;
+      options.io = io;
+
+      long faults = 0;
+      for (unsigned long run = 0; run < runs; ++run) {
+        if (cold) {
+          otb::evict(filename);
+        }
+        auto before = major_faults();
+        otb::load(filename, "OTBM", options);
+        faults += major_faults() - before;
+      }
+
+      auto per_run = [&](double ms) { return ms / static_cast<double>(runs); };
+      fmt::print("{:<18s} {:4s}: map file {:8.1f} ms, tree scan {:8.1f} ms, total {:8.1f} ms, {:6d} major faults\n", name, cold ? "cold" : "warm",
+                 per_run(stats.map_file.wall_ms), per_run(stats.tree_scan.wall_ms), per_run(stats.map_file.wall_ms + stats.tree_scan.wall_ms),
+                 faults / static_cast<long>(runs));
+    }
+  }
+  return 0;
+}
+
+int pathfinding(int argc, char **argv) {
+  if (argc < 2) {
+    fmt::print("usage: bench pathfinding <items.otb> <map.otbm> [queries] [radius]\n");
+    return 1;
+  }
+
+  auto queries = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+  auto radius = static_cast<uint16_t>(argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 32);
+
+  auto items = otbi::load(argv[0]);
+  auto map = otbm::load(argv[1], items);
+
+  auto start = clock_type::now();
+  auto grid = otbm::Grid{map};
+  fmt::print("Built grid in {:.1f} ms.\n", elapsed_ms(start));
+
+  std::vector<otbm::Coords> walkable;
+  for (const auto &[coords, tile] : map.tiles()) {
+    if (grid.walkable(coords)) {
+      walkable.push_back(coords);
+    }
+  }
+  if (walkable.empty()) {
+    fmt::print("No walkable tiles.\n");
+    return 1;
+  }
+
+  auto rng = std::mt19937{42};
+  auto pick = std::uniform_int_distribution<size_t>{0, walkable.size() - 1};
+  auto offset = std::uniform_int_distribution<int>{-radius / 2, radius / 2};
+
+  std::vector<std::pair<otbm::Coords, otbm::Coords>> pairs;
+  pairs.reserve(queries);
+  while (pairs.size() < queries) {
+    auto from = walkable[pick(rng)];
+    for (int attempt = 0; attempt < 16; ++attempt) {
+      auto x = from.x + offset(rng), y = from.y + offset(rng);
+      auto to = otbm::Coords{static_cast<uint16_t>(std::clamp(x, 0, 0xFFFF)), static_cast<uint16_t>(std::clamp(y, 0, 0xFFFF)), from.z};
+      if (grid.walkable(to)) {
+        pairs.emplace_back(from, to);
+        break;
+      }
+    }
+  }
+
+  auto pathfinder = otbm::Pathfinder{grid, radius};
+  std::vector<otbm::Direction> path;
+  path.reserve(4 * radius);
+
+  size_t found = 0, steps = 0, expanded = 0;
+  start = clock_type::now();
+  for (const auto &[from, to] : pairs) {
+    if (pathfinder.find(from, to, path)) {
+      ++found;
+      steps += path.size();
+    }
+    expanded += pathfinder.expanded();
+  }
+  auto ms = elapsed_ms(start);
+
+  fmt::print("{:d} queries in {:.1f} ms ({:.2f} us/query), {:d} found, {:.1f} steps and {:.1f} expanded nodes on average.\n", pairs.size(), ms,
+             1000 * ms / static_cast<double>(pairs.size()), found, found ? static_cast<double>(steps) / static_cast<double>(found) : 0.0,
+             static_cast<double>(expanded) / static_cast<double>(pairs.size()));
+  return 0;
+}
+
+int sight(int argc, char **argv) {
+  if (argc < 2) {
+    fmt::print("usage: bench sight <items.otb> <map.otbm> [queries] [threads]\n");
+    return 1;
+  }
+
+  auto queries = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 1000000;
+  auto threads = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::thread::hardware_concurrency();
+
+  auto items = otbi::load(argv[0]);
+  auto map = otbm::load(argv[1], items);
+  auto grid = otbm::Grid{map};
+
+  std::vector<otbm::Coords> positions;
+  for (const auto &[coords, tile] : map.tiles()) {
+    positions.push_back(coords);
+  }
+  if (positions.empty()) {
+    fmt::print("Empty map.\n");
+    return 1;
+  }
+
+  // Spell and ranged attack checks stay within the viewport.
+  auto rng = std::mt19937{42};
+  auto pick = std::uniform_int_distribution<size_t>{0, positions.size() - 1};
+  auto offset = std::uniform_int_distribution<int>{-8, 8};
+  std::vector<otbm::Coords> from(queries), to(queries);
+  for (size_t i = 0; i < queries; ++i) {
+    from[i] = positions[pick(rng)];
+    to[i] = {static_cast<uint16_t>(std::clamp(from[i].x + offset(rng), 0, 0xFFFF)), static_cast<uint16_t>(std::clamp(from[i].y + offset(rng), 0, 0xFFFF)),
+             from[i].z};
+  }
+
+  auto results = std::make_unique<bool[]>(queries);
+  auto start = clock_type::now();
+  for (size_t i = 0; i < queries; ++i) {
+    results[i] = otbm::line_of_sight(grid, from[i], to[i]);
+  }
+  auto single_ms = elapsed_ms(start);
+
+  start = clock_type::now();
+  otbm::line_of_sight(grid, from.data(), to.data(), queries, results.get());
+  auto batch_ms = elapsed_ms(start);
+
+  std::vector<std::thread> workers;
+  auto slice = (queries + threads - 1) / threads;
+  start = clock_type::now();
+  for (size_t first = 0; first < queries; first += slice) {
+    auto count = std::min(slice, queries - first);
+    workers.emplace_back([&, first, count] { otbm::line_of_sight(grid, from.data() + first, to.data() + first, count, results.get() + first); });
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  auto threaded_ms = elapsed_ms(start);
+
+  auto clear = std::count(results.get(), results.get() + queries, true);
+  fmt::print("{:d} queries, {:d} clear: single {:.1f} ms, batch {:.1f} ms, batch on {:d} threads {:.1f} ms.\n", queries, clear, single_ms, batch_ms,
+             workers.size(), threaded_ms);
+  return 0;
+}
+
+int shards(int argc, char **argv) {
+  if (argc < 2) {
+    fmt::print("usage: bench shards <items.otb> <map.otbm> [floor split] [stripe width] [stripes]\n");
+    return 1;
+  }
+
+  auto layout = otbm::ShardLayout{};
+  if (argc > 2) {
+    layout.floor_splits.push_back(static_cast<uint8_t>(std::strtoul(argv[2], nullptr, 10)));
+  }
+  layout.stripe_width = argc > 3 ? static_cast<uint16_t>(std::strtoul(argv[3], nullptr, 10)) : 0;
+  layout.stripes = argc > 4 ? static_cast<uint16_t>(std::strtoul(argv[4], nullptr, 10)) : 1;
+  layout.numa = true;
+
+  auto items = otbi::load(argv[0]);
+
+  auto start = clock_type::now();
+  auto map = otbm::load(argv[1], items);
+  auto map_ms = elapsed_ms(start);
+
+  start = clock_type::now();
+  auto sharded = otbm::load_sharded(argv[1], items, layout);
+  auto sharded_ms = elapsed_ms(start);
+
+  for (size_t i = 0; i < sharded.size(); ++i) {
+    const auto &shard = sharded.shard(i);
+    fmt::print("  shard {:3d}: {:9d} tiles, {:9d} container items, numa node {:d}\n", i, shard.tiles.size(), shard.contents.size(), shard.numa_node);
+  }
+
+  std::vector<otbm::Coords> positions;
+  for (const auto &[coords, tile] : map.tiles()) {
+    positions.push_back(coords);
+  }
+  std::shuffle(positions.begin(), positions.end(), std::mt19937{42});
+
+  start = clock_type::now();
+  size_t found = 0;
+  for (const auto &coords : positions) {
+    found += map.tiles().find(coords) != map.tiles().end();
+  }
+  auto map_lookup_ms = elapsed_ms(start);
+
+  start = clock_type::now();
+  size_t sharded_found = 0;
+  for (const auto &coords : positions) {
+    sharded_found += sharded.find(coords) != nullptr;
+  }
+  auto sharded_lookup_ms = elapsed_ms(start);
+
+  fmt::print("{:d} shards: load {:.1f} ms (single table {:.1f} ms), {:d} of {:d} tiles found in {:.1f} ms (single table {:.1f} ms).\n", sharded.size(),
+             sharded_ms, map_ms, sharded_found, found, sharded_lookup_ms, map_lookup_ms);
+  return sharded_found == found ? 0 : 1;
+}
+
+// A tile with its topmost item moved onto another, rebuilt rather than edited as a game thread would publish it.
+std::pair<otbm::Tile, otbm::Tile> move_top_item(const otbm::Tile &from, const otbm::Tile &to) {
+  auto source = otbm::Tile{from.flags()};
+  if (from.ground()) {
+    source.emplace_item(otb::Item{*from.ground()});
+  }
+  for (size_t i = 0; i + 1 < from.items().size(); ++i) {
+    source.emplace_item(otb::Item{from.items()[i]});
+  }
+  auto target = otbm::Tile{to};
+  if (not from.items().empty()) {
+    target.emplace_item(otb::Item{from.items().back()});
+  }
+  return {std::move(source), std::move(target)};
+}
+
+int concurrent(int argc, char **argv) {
+  if (argc < 2) {
+    fmt::print("usage: bench concurrent <items.otb> <map.otbm> [max readers] [ms per run]\n");
+    return 1;
+  }
+
+  auto max_readers = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : std::max(1u, std::thread::hardware_concurrency());
+  auto duration = std::chrono::milliseconds{argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 500};
+
+  auto items = otbi::load(argv[0]);
+  auto map = otbm::load(argv[1], items);
+  std::vector<otbm::Coords> positions;
+  for (const auto &[coords, tile] : map.tiles()) {
+    positions.push_back(coords);
+  }
+  if (positions.size() < 2) {
+    fmt::print("Empty map.\n");
+    return 1;
+  }
+
+  auto locked_tiles = map.release_tiles();
+  auto locked_mutex = std::mutex{};
+  auto concurrent_map = otbm::ConcurrentMap{otbm::load(argv[1], items)};
+
+  // One writer moves items between random tiles for as long as `readers` threads look random tiles up, in batches of 64 per guard or lock.
+  auto run = [&](size_t readers, auto &&read_batch, auto &&write) {
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> hits{0};
+    std::vector<uint64_t> reads(readers);
+    uint64_t writes = 0;
+
+    std::vector<std::thread> threads;
+    for (size_t r = 0; r < readers; ++r) {
+      threads.emplace_back([&, r] {
+        auto rng = std::mt19937{static_cast<unsigned>(r)};
+        auto pick = std::uniform_int_distribution<size_t>{0, positions.size() - 1};
+        std::array<otbm::Coords, 64> batch;
+        uint64_t count = 0, found = 0;
+        while (not stop.load(std::memory_order_relaxed)) {
+          for (auto &coords : batch) {
+            coords = positions[pick(rng)];
+          }
+          found += read_batch(batch);
+          count += batch.size();
+        }
+        reads[r] = count;
+        hits += found;
+      });
+    }
+    threads.emplace_back([&] {
+      auto rng = std::mt19937{42};
+      auto pick = std::uniform_int_distribution<size_t>{0, positions.size() - 1};
+      while (not stop.load(std::memory_order_relaxed)) {
+        write(positions[pick(rng)], positions[pick(rng)]);
+        ++writes;
+      }
+    });
+
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto seconds = std::chrono::duration<double>(duration).count();
+    return std::pair{static_cast<double>(std::accumulate(reads.begin(), reads.end(), uint64_t{0})) / seconds, static_cast<double>(writes) / seconds};
+  };
+
+  auto locked_read = [&](const std::array<otbm::Coords, 64> &batch) {
+    auto lock = std::lock_guard{locked_mutex};
+    uint64_t found = 0;
+    for (const auto &coords : batch) {
+      found += locked_tiles.find(coords) != locked_tiles.end();
+    }
+    return found;
+  };
+  auto locked_write = [&](const otbm::Coords &from, const otbm::Coords &to) {
+    auto lock = std::lock_guard{locked_mutex};
+    auto source = locked_tiles.find(from), target = locked_tiles.find(to);
+    if (not (from == to) and source != locked_tiles.end() and target != locked_tiles.end()) {
+      auto [new_source, new_target] = move_top_item(source->second, target->second);
+      source.value() = std::move(new_source);
+      target.value() = std::move(new_target);
+    }
+  };
+
+  auto concurrent_read = [&](const std::array<otbm::Coords, 64> &batch) {
+    auto guard = concurrent_map.read();
+    uint64_t found = 0;
+    for (const auto &coords : batch) {
+      auto tile = guard.find(coords);
+      found += tile and not tile->items().empty();
+    }
+    return found;
+  };
+  auto concurrent_write = [&](const otbm::Coords &from, const otbm::Coords &to) {
+    auto guard = concurrent_map.read();
+    auto source = guard.find(from), target = guard.find(to);
+    if (not (from == to) and source and target) {
+      auto [new_source, new_target] = move_top_item(*source, *target);
+      concurrent_map.update(from, std::move(new_source));
+      concurrent_map.update(to, std::move(new_target));
+    }
+  };
+
+  fmt::print("{:>7s} {:>16s} {:>16s} {:>16s} {:>16s}\n", "readers", "locked reads/s", "locked writes/s", "rcu reads/s", "rcu writes/s");
+  for (size_t readers = 1; readers <= max_readers; readers *= 2) {
+    auto [locked_reads, locked_writes] = run(readers, locked_read, locked_write);
+    auto [rcu_reads, rcu_writes] = run(readers, concurrent_read, concurrent_write);
+    fmt::print("{:7d} {:16.0f} {:16.0f} {:16.0f} {:16.0f}\n", readers, locked_reads, locked_writes, rcu_reads, rcu_writes);
+  }
+  return 0;
+}
+
+int wire(int argc, char **argv) {
+  if (argc < 2) {
+    fmt::print("usage: bench wire <items.otb> <map.otbm> [viewports]\n");
+    return 1;
+  }
+
+  auto viewports = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+
+  auto items = otbi::load(argv[0]);
+  auto map = otbm::load(argv[1], items);
+
+  auto start = clock_type::now();
+  auto descriptions = otbm::TileDescriptions{map};
+  fmt::print("Described {:d} tiles in {:.1f} ms, {:.1f} MiB.\n", map.tiles().size(), elapsed_ms(start),
+             static_cast<double>(descriptions.memory_usage()) / (1 << 20));
+
+  std::vector<otbm::Coords> positions;
+  for (const auto &[coords, tile] : map.tiles()) {
+    positions.push_back(coords);
+  }
+  if (positions.empty()) {
+    fmt::print("Empty map.\n");
+    return 1;
+  }
+
+  // What a client sees around a player: 18x14 tiles.
+  auto rng = std::mt19937{42};
+  auto pick = std::uniform_int_distribution<size_t>{0, positions.size() - 1};
+  std::vector<std::pair<otbm::Rect, uint8_t>> areas;
+  areas.reserve(viewports);
+  while (areas.size() < viewports) {
+    auto centre = positions[pick(rng)];
+    auto x0 = static_cast<uint16_t>(std::clamp(centre.x - 8, 0, 0xFFFF - 17));
+    auto y0 = static_cast<uint16_t>(std::clamp(centre.y - 6, 0, 0xFFFF - 13));
+    areas.push_back({{x0, y0, static_cast<uint16_t>(x0 + 17), static_cast<uint16_t>(y0 + 13)}, centre.z});
+  }
+
+  auto encode = [&](std::vector<uint8_t> &out) {
+    out.clear();
+    for (const auto &[area, z] : areas) {
+      for (uint32_t y = area.y0; y <= area.y1; ++y) {
+        for (uint32_t x = area.x0; x <= area.x1; ++x) {
+          auto it = map.tiles().find({static_cast<uint16_t>(x), static_cast<uint16_t>(y), z});
+          if (it != map.tiles().end()) {
+            otbm::describe_tile(it->second, out);
+          } else {
+            out.push_back(0);
+          }
+        }
+      }
+    }
+  };
+  auto concatenate = [&](std::vector<uint8_t> &out) {
+    out.clear();
+    for (const auto &[area, z] : areas) {
+      descriptions.describe(area, z, out);
+    }
+  };
+
+  std::vector<uint8_t> encoded, concatenated;
+  encode(encoded);
+  concatenate(concatenated);
+  if (encoded != concatenated) {
+    fmt::print("Cached descriptions differ from encoding the tiles.\n");
+    return 1;
+  }
+
+  // Both of the above encode fluids alike, so their client colors are checked against known ones: life fluid is red, a splash of it too.
+  auto vial_type = otb::ItemType{"vial", "", 0, 0, 1, 2874, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, otb::item_group::FLUID, otb::item_type::NONE};
+  auto splash_type = otb::ItemType{"splash", "", 0, 0, 2, 2889, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, otb::item_group::SPLASH, otb::item_type::NONE};
+  auto fluid_tile = otbm::Tile{};
+  for (auto [type, fluid] : {std::pair{&vial_type, 10}, std::pair{&splash_type, 7}}) {
+    auto item = otb::Item{type};
+    item.subtype(static_cast<uint8_t>(fluid));
+    fluid_tile.emplace_item(std::move(item));
+  }
+  std::vector<uint8_t> fluids;
+  otbm::describe_tile(fluid_tile, fluids);
+  // The splash placed last is sent first, in purple, then the vial of life fluid in red.
+  constexpr std::array<uint8_t, 7> expected_fluids = {2, 0x49, 0x0B, 2, 0x3A, 0x0B, 5};
+  if (not std::equal(fluids.begin(), fluids.end(), expected_fluids.begin(), expected_fluids.end())) {
+    fmt::print("Fluids are sent in the wrong client colors.\n");
+    return 1;
+  }
+
+  start = clock_type::now();
+  encode(encoded);
+  auto encode_ms = elapsed_ms(start);
+  start = clock_type::now();
+  concatenate(concatenated);
+  auto concatenate_ms = elapsed_ms(start);
+  fmt::print("{:d} viewports of {:.1f} bytes on average: encoded in {:.3f} us, concatenated in {:.3f} us each.\n", areas.size(),
+             static_cast<double>(encoded.size()) / static_cast<double>(areas.size()), 1000 * encode_ms / static_cast<double>(areas.size()),
+             1000 * concatenate_ms / static_cast<double>(areas.size()));
+
+  // Describing a tile anew moves the rest of its sector, the cost of every change a server makes to a tile.
+  start = clock_type::now();
+  for (size_t i = 0; i < viewports; ++i) {
+    auto coords = positions[pick(rng)];
+    descriptions.update(coords, &map.tiles().at(coords));
+  }
+  fmt::print("{:d} updates in {:.1f} ms.\n", viewports, elapsed_ms(start));
+  concatenate(concatenated);
+  if (encoded != concatenated) {
+    fmt::print("Updated descriptions differ from encoding the tiles.\n");
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  auto benchmark = std::string_view{argc > 1 ? argv[1] : ""};
+  if (benchmark == "allocations") {
+    return allocations(argc - 2, argv + 2);
+  }
+  if (benchmark == "attributes") {
+    return attributes(argc - 2, argv + 2);
+  }
+  if (benchmark == "load") {
+    return load(argc - 2, argv + 2);
+  }
+  if (benchmark == "items") {
+    return items(argc - 2, argv + 2);
+  }
+  if (benchmark == "presize") {
+    return presize(argc - 2, argv + 2);
+  }
+  if (benchmark == "unescape") {
+    return unescape(argc - 2, argv + 2);
+  }
+  if (benchmark == "io") {
+    return io(argc - 2, argv + 2);
+  }
+  if (benchmark == "pathfinding") {
+    return pathfinding(argc - 2, argv + 2);
+  }
+  if (benchmark == "sight") {
+    return sight(argc - 2, argv + 2);
+  }
+  if (benchmark == "concurrent") {
+    return concurrent(argc - 2, argv + 2);
+  }
+  if (benchmark == "shards") {
+    return shards(argc - 2, argv + 2);
+  }
+  if (benchmark == "wire") {
+    return wire(argc - 2, argv + 2);
+  }
+
+  fmt::print("usage: bench <benchmark> [args...]\nbenchmarks: allocations, attributes, concurrent, io, items, load, pathfinding, presize, shards, sight, unescape, wire\n");
+  return 1;
+}
@@ -0,0 +1,171 @@
+#include "concurrent.h"
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <limits>
+#include <stdexcept>
+
+namespace otbm {
+
+namespace {
+
+constexpr auto IDLE = std::numeric_limits<uint64_t>::max();
+
+std::atomic<uint64_t> next_id{1};
+
+} // namespace
+
+// A reader thread's announcement: the epoch it entered its outermost guard in, or IDLE. Records are never freed before the map, so the
+// writer can walk the list without locking.
+struct alignas(64) ConcurrentMap::Reader {
+  std::atomic<uint64_t> epoch{IDLE};
+  std::thread::id thread = {};
+  // Nesting depth of the owner's guards, only touched by the owner.
+  unsigned depth = 0;
+  Reader *next = nullptr;
+};
+
+ConcurrentMap::ConcurrentMap(Map &&map, size_t spare_tiles) : map{std::move(map)}, id{next_id++} {
+  auto tiles = this->map.release_tiles();
+
+  // At most half full, so probes stay short.
+  auto capacity = size_t{16};
+  while (capacity < 2 * (tiles.size() + spare_tiles)) {
+    capacity *= 2;
+  }
+  slots = std::make_unique<Slot[]>(capacity);
+  mask = capacity - 1;
+
+  for (auto it = tiles.begin(); it != tiles.end(); ++it) {
+    publish(it->first, std::move(it.value()));
+  }
+}
+
+ConcurrentMap::~ConcurrentMap() {
+  for (size_t i = 0; i <= mask; ++i) {
+    delete slots[i].tile.load(std::memory_order_relaxed);
+  }
+  for (const auto &version : retired) {
+    delete version.tile;
+  }
+  for (auto reader = readers.load(std::memory_order_relaxed); reader;) {
+    delete std::exchange(reader, reader->next);
+  }
+}
+
+ConcurrentMap::Reader &ConcurrentMap::local() const {
+  // Cache the calling thread's record, keyed by map so reused addresses cannot alias.
+  thread_local struct {
+    uint64_t owner = 0;
+    Reader *reader = nullptr;
+  } cache;
+
+  if (cache.owner != id) {
+    auto lock = std::lock_guard{readers_mutex};
+    auto thread = std::this_thread::get_id();
+    auto reader = readers.load(std::memory_order_relaxed);
+    while (reader and reader->thread != thread) {
+      reader = reader->next;
+    }
+    if (not reader) {
+      reader = new Reader{};
+      reader->thread = thread;
+      reader->next = readers.load(std::memory_order_relaxed);
+      readers.store(reader, std::memory_order_release);
+    }
+    cache.owner = id;
+    cache.reader = reader;
+  }
+  return *cache.reader;
+}
+
+ConcurrentMap::ReadGuard::ReadGuard(const ConcurrentMap &map) : map{map}, reader{map.local()} {
+  if (reader.depth++ == 0) {
+    reader.epoch.store(map.epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+    // Pairs with the fence in retire(): either the writer sees this announcement, or the lookups below see the new version.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+  }
+}
+
+ConcurrentMap::ReadGuard::~ReadGuard() {
+  if (--reader.depth == 0) {
+    reader.epoch.store(IDLE, std::memory_order_release);
+  }
+}
+
+void ConcurrentMap::update(const Coords &coords, Tile &&tile) {
+  auto lock = std::lock_guard{write_mutex};
+  publish(coords, std::move(tile));
+}
+
+bool ConcurrentMap::erase(const Coords &coords) {
+  auto lock = std::lock_guard{write_mutex};
+  auto slot = const_cast<Slot *>(find_slot(key(coords)));
+  if (not slot) {
+    return false;
+  }
+  auto previous = slot->tile.exchange(nullptr, std::memory_order_acq_rel);
+  if (previous) {
+    size_.fetch_sub(1, std::memory_order_relaxed);
+    retire(previous);
+  }
+  return previous != nullptr;
+}
+
+void ConcurrentMap::publish(const Coords &coords, Tile &&tile) {
+  auto key = ConcurrentMap::key(coords);
+  auto version = new Tile{std::move(tile)};
+
+  for (auto i = hash(key) & mask, probes = size_t{0}; probes <= mask; i = (i + 1) & mask, ++probes) {
+    auto &slot = slots[i];
+    auto found = slot.key.load(std::memory_order_relaxed);
+    if (found == key) {
+      if (auto previous = slot.tile.exchange(version, std::memory_order_acq_rel)) {
+        retire(previous);
+      } else {
+        size_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return;
+    }
+    if (found == 0) {
+      // The version goes in before the key, so a reader that finds the key also finds the tile.
+      slot.tile.store(version, std::memory_order_relaxed);
+      slot.key.store(key, std::memory_order_release);
+      size_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  delete version;
+  throw std::length_error(fmt::format("Concurrent map is full ({:d} tiles).", capacity()));
+}
+
+void ConcurrentMap::retire(const Tile *tile) {
+  // Readers that announced an epoch up to the tag may have loaded the old version; later ones can only see the new one.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  retired.push_back({tile, epoch.fetch_add(1, std::memory_order_acq_rel)});
+  if (retired.size() >= collect_at) {
+    reclaim();
+    // Versions a slow reader holds on to are not rescanned on every update.
+    collect_at = retired.size() + COLLECT_THRESHOLD;
+  }
+}
+
+void ConcurrentMap::collect() {
+  auto lock = std::lock_guard{write_mutex};
+  reclaim();
+}
+
+void ConcurrentMap::reclaim() {
+  auto oldest = IDLE;
+  for (auto reader = readers.load(std::memory_order_acquire); reader; reader = reader->next) {
+    oldest = std::min(oldest, reader->epoch.load(std::memory_order_acquire));
+  }
+  auto freed = std::partition(retired.begin(), retired.end(), [oldest](const Retired &version) { return version.epoch >= oldest; });
+  for (auto it = freed; it != retired.end(); ++it) {
+    delete it->tile;
+  }
+  retired.erase(freed, retired.end());
+}
+
+} // namespace otbm
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "coords.h"
+#include "otbm.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace otbm {
+
+// A loaded map shared between threads: lookups are wait-free, and writers replace whole tiles by publishing a new version of them. Readers
+// look tiles up inside a ReadGuard, and a replaced version is only freed once every guard that might still see it is gone (epoch based
+// reclamation).
+//
+// The table is open addressed with a fixed capacity chosen at construction, so lookups never meet a rehash; `spare_tiles` reserves room for
+// tiles added later.
+class ConcurrentMap {
+  struct Reader;
+
+public:
+  explicit ConcurrentMap(Map &&map, size_t spare_tiles = 0);
+  ~ConcurrentMap();
+
+  ConcurrentMap(const ConcurrentMap &) = delete;
+  ConcurrentMap &operator=(const ConcurrentMap &) = delete;
+
+  // Keeps every tile version seen through it alive until destroyed. Guards nest, and belong to the thread that made them.
+  class ReadGuard {
+  public:
+    explicit ReadGuard(const ConcurrentMap &map);
+    ~ReadGuard();
+
+    ReadGuard(const ReadGuard &) = delete;
+    ReadGuard &operator=(const ReadGuard &) = delete;
+
+    const Tile *find(const Coords &coords) const {
+      auto slot = map.find_slot(key(coords));
+      return slot ? slot->tile.load(std::memory_order_acquire) : nullptr;
+    }
+
+  private:
+    const ConcurrentMap &map;
+    Reader &reader;
+  };
+
+  ReadGuard read() const { return ReadGuard{*this}; }
+
+  // Writers are serialized among themselves, never against readers.
+
+  // Publishes `tile` as the new version of the tile at `coords`, adding the tile if there was none.
+  void update(const Coords &coords, Tile &&tile);
+
+  // Publishes a copy of the current tile (or an empty one) as changed by fn(Tile &).
+  template <class F> void modify(const Coords &coords, F &&fn) {
+    auto lock = std::lock_guard{write_mutex};
+    auto slot = find_slot(key(coords));
+    auto current = slot ? slot->tile.load(std::memory_order_relaxed) : nullptr;
+    auto tile = current ? Tile{*current} : Tile{};
+    fn(tile);
+    publish(coords, std::move(tile));
+  }
+
+  // Removes the tile at `coords`. Returns whether there was one.
+  bool erase(const Coords &coords);
+
+  // Frees the replaced versions no reader can see anymore. Writers call it as they go; calling it again is only useful to release memory
+  // sooner.
+  void collect();
+
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+  size_t capacity() const { return mask + 1; }
+
+  auto &towns() const { return map.towns(); }
+  auto &waypoints() const { return map.waypoints(); }
+  auto &houses() const { return map.houses(); }
+  auto &spawns() const { return map.spawns(); }
+
+private:
+  // Replaced versions piling up between attempts to free them.
+  static constexpr size_t COLLECT_THRESHOLD = 64;
+
+  // Key 0 marks a free slot. Keys are never removed, so a probe that reaches a free slot has missed; erased tiles leave a null version.
+  struct Slot {
+    std::atomic<uint64_t> key{0};
+    std::atomic<const Tile *> tile{nullptr};
+  };
+
+  struct Retired {
+    const Tile *tile;
+    uint64_t epoch;
+  };
+
+  static constexpr uint64_t key(const Coords &coords) {
+    return (static_cast<uint64_t>(coords.x) << 24 | static_cast<uint64_t>(coords.y) << 8 | coords.z) + 1;
+  }
+
+  static constexpr uint64_t hash(uint64_t key) { return (key * 0x9E3779B97F4A7C15ull) >> 20; }
+
+  const Slot *find_slot(uint64_t key) const {
+    for (auto i = hash(key) & mask, probes = size_t{0}; probes <= mask; i = (i + 1) & mask, ++probes) {
+      auto found = slots[i].key.load(std::memory_order_acquire);
+      if (found == key) {
+        return &slots[i];
+      }
+      if (found == 0) {
+        return nullptr;
+      }
+    }
+    return nullptr;
+  }
+
+  Reader &local() const;
+  void publish(const Coords &coords, Tile &&tile);
+  // Both need write_mutex held.
+  void retire(const Tile *tile);
+  void reclaim();
+
+  Map map;
+  std::unique_ptr<Slot[]> slots = {};
+  size_t mask = 0;
+  std::atomic<size_t> size_{0};
+
+  std::atomic<uint64_t> epoch{1};
+  mutable std::mutex readers_mutex = {};
+  mutable std::atomic<Reader *> readers{nullptr};
+  uint64_t id;
+
+  std::mutex write_mutex = {};
+  std::vector<Retired> retired = {};
+  size_t collect_at = COLLECT_THRESHOLD;
+};
+
+} // namespace otbm
@@ -0,0 +1,150 @@
+#include "diagnostics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fmt/format.h>
+#include <numeric>
+
+namespace otb {
+
+namespace {
+
+std::atomic<uint64_t> next_id{1};
+
+} // namespace
+
+const char *describe(DecodeError error) {
+  switch (error) {
+  case DecodeError::NONE:
+    return "no error";
+  case DecodeError::TRUNCATED:
+    return "data ends early";
+  case DecodeError::UNKNOWN_NODE_TYPE:
+    return "unknown node type";
+  case DecodeError::UNKNOWN_ATTRIBUTE:
+    return "unknown attribute";
+  case DecodeError::UNKNOWN_ITEM_ID:
+    return "unknown item id";
+  case DecodeError::INVALID_ITEM_ATTRIBUTE:
+    return "invalid item attribute";
+  default:
+    return "unknown error";
+  }
+}
+
+std::string describe(const Diagnostic &diagnostic) {
+  const auto &coords = diagnostic.coords;
+
+  switch (diagnostic.code) {
+  case Warning::GENERIC_CLIENT_VERSION:
+    return "items.otb using generic client version";
+
+  case Warning::LONG_ITEM_NAME:
+    return fmt::format("Unexpected item name length {:d} (sid {:d})", diagnostic.value, diagnostic.item_id);
+
+  case Warning::LONG_ITEM_DESCRIPTION:
+    return fmt::format("Unexpected item description length {:d} (sid {:d})", diagnostic.value, diagnostic.item_id);
+
+  case Warning::UNKNOWN_ITEM_TYPE_ATTRIBUTE:
+    return fmt::format("Unknown attribute {:d} length {:d} (sid {:d})", diagnostic.attribute, diagnostic.value, diagnostic.item_id);
+
+  case Warning::MOVEABLE_HOUSE_ITEM:
+    return fmt::format("Moveable item with ID {:d} in house {:d} @ ({:d}, {:d}, {:d})", diagnostic.item_id, diagnostic.value, coords.x, coords.y,
+                       coords.z);
+
+  case Warning::UNKNOWN_ITEM_ATTRIBUTE:
+    return fmt::format("Unknown item attribute {:d} (ID {:d} @ ({:d}, {:d}, {:d}))", diagnostic.attribute, diagnostic.item_id, coords.x, coords.y,
+                       coords.z);
+
+  case Warning::UNKNOWN_HOUSE:
+    return fmt::format("House {:d} is not in the house file (first tile @ ({:d}, {:d}, {:d}))", diagnostic.value, coords.x, coords.y, coords.z);
+
+  case Warning::DUPLICATE_UNIQUE_ID:
+    return fmt::format("Duplicate unique id {:d} on item with ID {:d} @ ({:d}, {:d}, {:d})", diagnostic.value, diagnostic.item_id, coords.x, coords.y,
+                       coords.z);
+
+  case Warning::SKIPPED_TILE:
+  case Warning::SKIPPED_TILE_AREA:
+    return fmt::format("Skipped {:s} @ ({:d}, {:d}, {:d}): {:s} (attribute {:d}, ID {:d}) at offset {:d}",
+                       diagnostic.code == Warning::SKIPPED_TILE ? "tile" : "tile area", coords.x, coords.y, coords.z,
+                       describe(static_cast<DecodeError>(diagnostic.value)), diagnostic.attribute, diagnostic.item_id, diagnostic.offset);
+
+  case Warning::MISSING_EXTERNAL_FILE:
+    return fmt::format("Could not load the {:s} file named by the map", diagnostic.value == 0 ? "house" : "spawn");
+
+  default:
+    return fmt::format("Unknown diagnostic {:d}", static_cast<int>(diagnostic.code));
+  }
+}
+
+uint64_t Diagnostics::Summary::total() const { return std::accumulate(counts.begin(), counts.end(), uint64_t{0}); }
+
+Diagnostics::Diagnostics(size_t samples_per_code) : samples_per_code{samples_per_code}, id{next_id++} {}
+
+Diagnostics::Buffer &Diagnostics::local() {
+  // Cache the calling thread's buffer, keyed by collector so reused addresses cannot alias.
+  thread_local struct {
+    uint64_t owner = 0;
+    Buffer *buffer = nullptr;
+  } cache;
+
+  if (cache.owner != id) {
+    auto lock = std::lock_guard{mutex};
+    auto thread = std::this_thread::get_id();
+    auto it = std::find_if(buffers.begin(), buffers.end(), [&](const auto &buffer) { return buffer->thread == thread; });
+    if (it == buffers.end()) {
+      it = buffers.insert(buffers.end(), std::make_unique<Buffer>(Buffer{thread}));
+    }
+    cache.owner = id;
+    cache.buffer = it->get();
+  }
+  return *cache.buffer;
+}
+
+void Diagnostics::report(const Diagnostic &diagnostic) {
+  auto &buffer = local();
+  auto &count = buffer.counts[static_cast<size_t>(diagnostic.code)];
+  if (count++ < samples_per_code) {
+    buffer.samples.push_back(diagnostic);
+  }
+}
+
+Diagnostics::Summary Diagnostics::summary() const {
+  auto lock = std::lock_guard{mutex};
+
+  auto out = Summary{};
+  std::array<size_t, CODES> sampled = {};
+  for (const auto &buffer : buffers) {
+    for (size_t code = 0; code < CODES; ++code) {
+      out.counts[code] += buffer->counts[code];
+    }
+    for (const auto &sample : buffer->samples) {
+      if (sampled[static_cast<size_t>(sample.code)]++ < samples_per_code) {
+        out.samples.push_back(sample);
+      }
+    }
+  }
+  return out;
+}
+
+void Diagnostics::print_summary() const {
+  auto summary = this->summary();
+  for (size_t code = 0; code < CODES; ++code) {
+    auto count = summary.counts[code];
+    if (count == 0) {
+      continue;
+    }
+
+    auto shown = std::count_if(summary.samples.begin(), summary.samples.end(), [&](const Diagnostic &sample) { return static_cast<size_t>(sample.code) == code; });
+    for (const auto &sample : summary.samples) {
+      if (static_cast<size_t>(sample.code) == code) {
+        fmt::print("[Warning] {:s}.\n", describe(sample));
+      }
+    }
+    if (count > static_cast<uint64_t>(shown)) {
+      fmt::print("[Warning] ... and {:d} more like the above.\n", count - static_cast<uint64_t>(shown));
+    }
+  }
+}
+
+} // namespace otb
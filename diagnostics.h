@@ -0,0 +1,105 @@
+#pragma once
+
+#include "coords.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace otb {
+
+enum class Warning : uint8_t {
+  GENERIC_CLIENT_VERSION,
+  LONG_ITEM_NAME,
+  LONG_ITEM_DESCRIPTION,
+  UNKNOWN_ITEM_TYPE_ATTRIBUTE,
+  MOVEABLE_HOUSE_ITEM,
+  UNKNOWN_ITEM_ATTRIBUTE,
+  UNKNOWN_HOUSE,
+  DUPLICATE_UNIQUE_ID,
+  // Parts of a map left out by a lenient load, with the DecodeError as value.
+  SKIPPED_TILE,
+  SKIPPED_TILE_AREA,
+  // A house (value 0) or spawn (value 1) file named by a map that could not be loaded. The map is loaded without it.
+  MISSING_EXTERNAL_FILE,
+
+  LAST
+};
+
+// Why a piece of a file could not be decoded.
+enum class DecodeError : uint8_t {
+  NONE,
+  // The data ended inside a value.
+  TRUNCATED,
+  UNKNOWN_NODE_TYPE,
+  UNKNOWN_ATTRIBUTE,
+  UNKNOWN_ITEM_ID,
+  // The payload of a known item attribute did not decode.
+  INVALID_ITEM_ATTRIBUTE,
+};
+
+const char *describe(DecodeError error);
+
+struct Diagnostic {
+  Warning code;
+  uint8_t attribute = 0;
+  uint16_t item_id = 0;
+  // Extra context depending on the code: attribute length, house id...
+  uint32_t value = 0;
+  otbm::Coords coords = {};
+  // Where in the file the problem was found, for errors in its data.
+  uint64_t offset = 0;
+};
+
+std::string describe(const Diagnostic &diagnostic);
+
+class DiagnosticSink {
+public:
+  virtual ~DiagnosticSink() = default;
+  virtual void report(const Diagnostic &diagnostic) = 0;
+};
+
+// Aggregates diagnostics without serializing reporters: each thread writes to its own buffer, keeping a count per code and only the first few
+// occurrences of each code as samples.
+class Diagnostics final : public DiagnosticSink {
+public:
+  static constexpr auto CODES = static_cast<size_t>(Warning::LAST);
+
+  struct Summary {
+    std::array<uint64_t, CODES> counts = {};
+    std::vector<Diagnostic> samples = {};
+
+    uint64_t total() const;
+  };
+
+  explicit Diagnostics(size_t samples_per_code = 5);
+
+  Diagnostics(const Diagnostics &) = delete;
+  Diagnostics &operator=(const Diagnostics &) = delete;
+
+  void report(const Diagnostic &diagnostic) override;
+
+  // Merges every thread's buffer. Not meant to run while threads are still reporting.
+  Summary summary() const;
+  void print_summary() const;
+
+private:
+  struct Buffer {
+    std::thread::id thread;
+    std::array<uint64_t, CODES> counts = {};
+    std::vector<Diagnostic> samples = {};
+  };
+
+  Buffer &local();
+
+  size_t samples_per_code;
+  uint64_t id;
+  mutable std::mutex mutex = {};
+  std::vector<std::unique_ptr<Buffer>> buffers = {};
+};
+
+} // namespace otb
@@ -0,0 +1,23 @@
+#include "digest.h"
+
+#include <fmt/format.h>
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fmt::print("usage: {:s} <from.otbm> <to.otbm>\n", argv[0]);
+    return 2;
+  }
+
+  auto diff = otbm::diff(argv[1], argv[2]);
+  if (diff.header_changed) {
+    fmt::print("header changed\n");
+  }
+
+  constexpr char kinds[] = {'+', '-', '~'};
+  for (const auto &change : diff.tiles) {
+    fmt::print("{:c} ({:d}, {:d}, {:d})\n", kinds[change.kind], change.coords.x, change.coords.y, change.coords.z);
+  }
+
+  fmt::print("{:d} area(s), {:d} tile(s) changed.\n", diff.areas.size(), diff.tiles.size());
+  return diff.header_changed or not diff.areas.empty() ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+#include "digest.h"
+#include "attributes.h"
+#include "otb.h"
+#include "otbm.h"
+#include "stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fmt/format.h>
+#include <stdexcept>
+#include <utility>
+
+namespace otbm {
+
+namespace {
+
+constexpr uint64_t PRIME_1 = 0x9E3779B97F4A7C15ull;
+constexpr uint64_t PRIME_2 = 0xC2B2AE3D27D4EB4Full;
+
+uint64_t mix(uint64_t hash, uint64_t value) {
+  hash ^= value * PRIME_2;
+  return (hash << 31 | hash >> 33) * PRIME_1;
+}
+
+uint64_t finalize(uint64_t hash) {
+  hash ^= hash >> 30;
+  hash *= 0xBF58476D1CE4E5B9ull;
+  hash ^= hash >> 27;
+  hash *= 0x94D049BB133111EBull;
+  return hash ^ (hash >> 31);
+}
+
+// Eight bytes per step; the hashes only need to be stable, not resistant to crafted collisions.
+uint64_t hash_bytes(otb::iterator first, const otb::iterator last, uint64_t seed) {
+  auto hash = mix(seed, static_cast<uint64_t>(last - first));
+  for (; last - first >= 8; first += 8) {
+    uint64_t word;
+    std::memcpy(&word, first, sizeof(word));
+    hash = mix(hash, word);
+  }
+
+  uint64_t tail = 0;
+  std::memcpy(&tail, first, static_cast<size_t>(last - first));
+  return finalize(mix(hash, tail));
+}
+
+uint64_t hash_node(const otb::node &node) { return hash_bytes(node.props_begin, node.node_end, static_cast<uint8_t>(node.type)); }
+
+uint64_t pack(const Coords &coords) { return static_cast<uint64_t>(coords.z) << 32 | static_cast<uint64_t>(coords.y) << 16 | coords.x; }
+
+bool before(const Coords &lhs, const Coords &rhs) { return pack(lhs) < pack(rhs); }
+
+struct Area {
+  Coords base;
+  uint64_t hash;
+  std::vector<const otb::node *> nodes;
+};
+
+// Points into the tree of the loader it was made from.
+struct Scan {
+  uint64_t header;
+  std::vector<Area> areas;
+};
+
+Scan scan(const otb::OTB &loader) {
+  if (loader.children().size() != 1 or loader.children().front().type != NODETYPE_MAP_DATA) {
+    throw std::invalid_argument("Could not read data node.");
+  }
+
+  const auto &map_node = loader.children().front();
+  auto header = mix(hash_bytes(loader.begin(), loader.end(), 0), hash_bytes(map_node.props_begin, map_node.props_end, NODETYPE_MAP_DATA));
+
+  std::vector<std::pair<Coords, const otb::node *>> nodes;
+  for (const auto &node : map_node.children) {
+    if (node.type == NODETYPE_TILE_AREA) {
+      auto first = node.props_begin;
+      auto x = read<uint16_t>(first, node.props_end);
+      auto y = read<uint16_t>(first, node.props_end);
+      auto z = read<uint8_t>(first, node.props_end);
+      if (z >= MAP_MAX_LAYERS) {
+        throw std::invalid_argument(fmt::format("Invalid tile area floor: {:d}", z));
+      }
+      nodes.emplace_back(Coords{x, y, z}, &node);
+    } else {
+      header = mix(header, hash_node(node));
+    }
+  }
+
+  // Stable, so areas sharing a base are hashed in file order.
+  std::stable_sort(nodes.begin(), nodes.end(), [](const auto &lhs, const auto &rhs) { return before(lhs.first, rhs.first); });
+
+  std::vector<Area> areas;
+  for (const auto &[base, node] : nodes) {
+    if (areas.empty() or not(areas.back().base == base)) {
+      areas.push_back({base, pack(base), {}});
+    }
+    areas.back().hash = mix(areas.back().hash, hash_node(*node));
+    areas.back().nodes.push_back(node);
+  }
+  for (auto &area : areas) {
+    area.hash = finalize(area.hash);
+  }
+
+  return {finalize(header), std::move(areas)};
+}
+
+Digest make_digest(const Scan &scan) {
+  Digest digest;
+  digest.header = scan.header;
+  digest.areas.reserve(scan.areas.size());
+  for (const auto &area : scan.areas) {
+    digest.floors[area.base.z] = mix(digest.floors[area.base.z], mix(pack(area.base), area.hash));
+    digest.areas.push_back({area.base, area.hash});
+  }
+
+  auto root = scan.header;
+  for (auto &floor : digest.floors) {
+    floor = finalize(floor);
+    root = mix(root, floor);
+  }
+  digest.root = finalize(root);
+  return digest;
+}
+
+using TileHashes = std::vector<Digest::Tile>;
+
+// Tile hashes leave out the offsets within the area, which are already part of the key.
+TileHashes hash_tiles(const Area &area) {
+  TileHashes tiles;
+  for (const auto *node : area.nodes) {
+    for (const auto &tile_node : node->children) {
+      if (tile_node.type != NODETYPE_TILE and tile_node.type != NODETYPE_HOUSETILE) {
+        throw std::invalid_argument(fmt::format("Unknown tile node: {:d}", tile_node.type));
+      }
+
+      auto first = tile_node.props_begin;
+      auto x = static_cast<uint16_t>(area.base.x + read<uint8_t>(first, tile_node.props_end));
+      auto y = static_cast<uint16_t>(area.base.y + read<uint8_t>(first, tile_node.props_end));
+      tiles.push_back({Coords{x, y, area.base.z}, hash_bytes(first, tile_node.node_end, static_cast<uint8_t>(tile_node.type))});
+    }
+  }
+
+  std::stable_sort(tiles.begin(), tiles.end(), [](const auto &lhs, const auto &rhs) { return before(lhs.coords, rhs.coords); });
+  return tiles;
+}
+
+} // namespace
+
+Digest digest(std::string_view filename) { return make_digest(scan(otb::load(filename, "OTBM"))); }
+
+std::vector<Digest::Tile> digest_tiles(std::string_view filename, const Coords &base) {
+  auto loader = otb::load(filename, "OTBM");
+  auto areas = scan(loader).areas;
+  auto it = std::lower_bound(areas.begin(), areas.end(), base, [](const Area &area, const Coords &base) { return before(area.base, base); });
+  if (it == areas.end() or not(it->base == base)) {
+    return {};
+  }
+  return hash_tiles(*it);
+}
+
+MapDiff diff(std::string_view from, std::string_view to) {
+  auto lhs_loader = otb::load(from, "OTBM");
+  auto rhs_loader = otb::load(to, "OTBM");
+  auto lhs = scan(lhs_loader);
+  auto rhs = scan(rhs_loader);
+  auto lhs_digest = make_digest(lhs);
+  auto rhs_digest = make_digest(rhs);
+
+  MapDiff result;
+  result.header_changed = lhs_digest.header != rhs_digest.header;
+  if (lhs_digest.root == rhs_digest.root) {
+    return result;
+  }
+
+  auto floor_range = [](const std::vector<Area> &areas, uint8_t z) {
+    auto first = std::lower_bound(areas.begin(), areas.end(), z, [](const Area &area, uint8_t z) { return area.base.z < z; });
+    auto last = std::upper_bound(first, areas.end(), z, [](uint8_t z, const Area &area) { return z < area.base.z; });
+    return std::make_pair(first, last);
+  };
+
+  for (uint8_t z = 0; z < MAP_MAX_LAYERS; ++z) {
+    if (lhs_digest.floors[z] == rhs_digest.floors[z]) {
+      continue;
+    }
+
+    auto [l, l_end] = floor_range(lhs.areas, z);
+    auto [r, r_end] = floor_range(rhs.areas, z);
+    while (l != l_end or r != r_end) {
+      const Area *left = nullptr, *right = nullptr;
+      if (r == r_end or (l != l_end and before(l->base, r->base))) {
+        left = &*l++;
+      } else if (l == l_end or before(r->base, l->base)) {
+        right = &*r++;
+      } else {
+        left = &*l++;
+        right = &*r++;
+        if (left->hash == right->hash) {
+          continue;
+        }
+      }
+
+      result.areas.push_back(left ? left->base : right->base);
+      auto left_tiles = left ? hash_tiles(*left) : TileHashes{};
+      auto right_tiles = right ? hash_tiles(*right) : TileHashes{};
+
+      auto lt = left_tiles.begin(), rt = right_tiles.begin();
+      while (lt != left_tiles.end() or rt != right_tiles.end()) {
+        if (rt == right_tiles.end() or (lt != left_tiles.end() and before(lt->coords, rt->coords))) {
+          result.tiles.push_back({TileChange::REMOVED, (lt++)->coords});
+        } else if (lt == left_tiles.end() or before(rt->coords, lt->coords)) {
+          result.tiles.push_back({TileChange::ADDED, (rt++)->coords});
+        } else {
+          if (lt->hash != rt->hash) {
+            result.tiles.push_back({TileChange::CHANGED, lt->coords});
+          }
+          ++lt, ++rt;
+        }
+      }
+    }
+  }
+
+  return result;
+}
+
+} // namespace otbm
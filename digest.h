@@ -0,0 +1,57 @@
+#pragma once
+
+#include "coords.h"
+#include "otbm.h"
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace otbm {
+
+// Content hashes of a map, computed from the raw node bytes after the tree scan without decoding tiles. Equal hashes mean equal encoded
+// content; the digest does not see through re-encodings that produce the same map from different bytes.
+struct Digest {
+  struct Area {
+    Coords base;
+    uint64_t hash;
+  };
+  struct Tile {
+    Coords coords;
+    uint64_t hash;
+  };
+
+  // Hash of the header, every floor and thus the whole map.
+  uint64_t root = 0;
+  // Map header, attributes, towns and waypoints.
+  uint64_t header = 0;
+  std::array<uint64_t, MAP_MAX_LAYERS> floors = {};
+  // One entry per area base, sorted by floor, then y, then x. Areas sharing a base are hashed together.
+  std::vector<Area> areas = {};
+};
+
+Digest digest(std::string_view filename);
+// Hashes of the tiles of the area based at `base`, of all its nodes when several share the base, sorted like Digest::areas. Empty when the
+// map has no such area. Only that area is hashed tile by tile, so a changed area found by comparing digests can be narrowed down on demand.
+std::vector<Digest::Tile> digest_tiles(std::string_view filename, const Coords &base);
+
+struct TileChange {
+  enum Kind { ADDED, REMOVED, CHANGED };
+
+  Kind kind;
+  Coords coords;
+};
+
+struct MapDiff {
+  bool header_changed = false;
+  // Bases of the tile areas whose content differs, including areas present on one side only.
+  std::vector<Coords> areas = {};
+  // Tiles of those areas added, removed or changed from `from` to `to`, sorted like Digest::areas.
+  std::vector<TileChange> tiles = {};
+};
+
+// Compares two revisions of a map. Floors and areas with equal digests are skipped; only the areas that differ are walked tile by tile.
+MapDiff diff(std::string_view from, std::string_view to);
+
+} // namespace otbm
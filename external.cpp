@@ -0,0 +1,68 @@
+#include "external.h"
+
+#include <fmt/format.h>
+#include <pugixml.hpp>
+#include <stdexcept>
+
+namespace otbm {
+
+namespace {
+
+void open(pugi::xml_document &document, const std::string &filename) {
+  if (auto result = document.load_file(filename.c_str()); not result) {
+    throw std::invalid_argument(fmt::format("Could not load {:s}: {:s}", filename, result.description()));
+  }
+}
+
+uint16_t as_u16(const pugi::xml_attribute &attribute) { return static_cast<uint16_t>(attribute.as_uint()); }
+uint8_t as_u8(const pugi::xml_attribute &attribute) { return static_cast<uint8_t>(attribute.as_uint()); }
+
+} // namespace
+
+Spawns load_spawns(const std::string &filename) {
+  pugi::xml_document document;
+  open(document, filename);
+
+  Spawns spawns;
+  for (const auto &spawn_node : document.child("spawns").children("spawn")) {
+    auto center = Coords{as_u16(spawn_node.attribute("centerx")), as_u16(spawn_node.attribute("centery")), as_u8(spawn_node.attribute("centerz"))};
+    auto &spawn = spawns.emplace_back(Spawn{center, spawn_node.attribute("radius").as_int(-1)});
+    if (spawn.radius < 0) {
+      throw std::invalid_argument(fmt::format("Missing radius for spawn at ({:d}, {:d}, {:d}) in {:s}", center.x, center.y, center.z, filename));
+    }
+
+    for (const auto &creature_node : spawn_node.children()) {
+      auto kind = std::string_view{creature_node.name()};
+      if (kind != "monster" and kind != "npc") {
+        continue;
+      }
+
+      // Creature positions are offsets from the spawn center, on its floor.
+      auto x = static_cast<uint16_t>(center.x + creature_node.attribute("x").as_int());
+      auto y = static_cast<uint16_t>(center.y + creature_node.attribute("y").as_int());
+      spawn.creatures.push_back(
+          {creature_node.attribute("name").as_string(), {x, y, center.z}, creature_node.attribute("spawntime").as_uint() * 1000, kind == "npc"});
+    }
+  }
+  return spawns;
+}
+
+Houses load_houses(const std::string &filename) {
+  pugi::xml_document document;
+  open(document, filename);
+
+  Houses houses;
+  for (const auto &house_node : document.child("houses").children("house")) {
+    auto id = house_node.attribute("houseid").as_uint();
+    if (id == 0) {
+      throw std::invalid_argument(fmt::format("Missing house id in {:s}", filename));
+    }
+
+    auto entry = Coords{as_u16(house_node.attribute("entryx")), as_u16(house_node.attribute("entryy")), as_u8(house_node.attribute("entryz"))};
+    houses.insert_or_assign(id, House{id, house_node.attribute("name").as_string(), entry, house_node.attribute("rent").as_uint(),
+                                      house_node.attribute("townid").as_uint(), house_node.attribute("guildhall").as_bool()});
+  }
+  return houses;
+}
+
+} // namespace otbm
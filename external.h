@@ -0,0 +1,45 @@
+#pragma once
+
+#include "coords.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tsl/robin_map.h>
+#include <vector>
+
+namespace otbm {
+
+struct SpawnedCreature {
+  std::string name;
+  Coords position;
+  // Respawn interval in milliseconds.
+  uint32_t interval;
+  bool npc;
+};
+
+struct Spawn {
+  Coords center;
+  int32_t radius;
+  std::vector<SpawnedCreature> creatures = {};
+};
+
+struct House {
+  uint32_t id = 0;
+  std::string name = {};
+  Coords entry = {};
+  uint32_t rent = 0;
+  uint32_t town_id = 0;
+  bool guildhall = false;
+  // Tiles of the map marked with this house, filled in when the map is loaded.
+  std::vector<Coords> tiles = {};
+};
+
+using Spawns = std::vector<Spawn>;
+using Houses = tsl::robin_map<uint32_t, House>;
+
+// Readers for the spawn and house files named by a map, in the XML layout written by map editors.
+Spawns load_spawns(const std::string &filename);
+Houses load_houses(const std::string &filename);
+
+} // namespace otbm
@@ -0,0 +1,162 @@
+#include "file.h"
+#include "reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace otb {
+
+namespace {
+
+constexpr size_t HUGE_PAGE_SIZE = size_t{2} << 20;
+
+[[noreturn]] void fail(const std::string &what) { throw std::system_error(errno, std::generic_category(), what); }
+
+// Hints only; kernels without them return EINVAL, which is not worth failing a load over.
+void advise(void *address, size_t length, bool sequential, bool huge_pages) {
+  if (sequential) {
+    madvise(address, length, MADV_SEQUENTIAL);
+    madvise(address, length, MADV_WILLNEED);
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    madvise(address, length, MADV_HUGEPAGE);
+  }
+#else
+  (void)huge_pages;
+#endif
+}
+
+} // namespace
+
+File::File(const std::string &filename, const IoOptions &options) : drop_cache{options.drop_cache} {
+  // Releases what was acquired so far, keeping the errno of the failed call.
+  auto release_and_fail = [this](const std::string &what, int error) {
+    release();
+    errno = error;
+    fail(what);
+  };
+
+  fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fail("Could not open " + filename);
+  }
+
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    release_and_fail("Could not stat " + filename, errno);
+  }
+  size_ = static_cast<size_t>(status.st_size);
+  if (size_ == 0) {
+    return;
+  }
+
+  if (options.sequential) {
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+
+  if (options.strategy == IoStrategy::MMAP) {
+    mapped_size = size_;
+    auto address = mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE | (options.populate ? MAP_POPULATE : 0), fd, 0);
+    if (address == MAP_FAILED) {
+      release_and_fail("Could not map " + filename, errno);
+    }
+    data_ = static_cast<char *>(address);
+    advise(address, mapped_size, options.sequential, options.huge_pages);
+    return;
+  }
+
+  // Anonymous memory rather than new[], so the buffer can take huge pages and is returned to the system on release.
+  mapped_size = options.huge_pages ? (size_ + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE : size_;
+  auto address = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | (options.populate ? MAP_POPULATE : 0), -1, 0);
+  if (address == MAP_FAILED) {
+    release_and_fail("Could not allocate a buffer for " + filename, errno);
+  }
+  data_ = static_cast<char *>(address);
+  advise(address, mapped_size, false, options.huge_pages);
+
+  if (options.strategy == IoStrategy::ASYNC) {
+    reader = std::make_unique<ChunkReader>(fd, data_, size_, options.read_size, options.queue_depth);
+    return;
+  }
+
+  for (size_t offset = 0; offset < size_;) {
+    auto count = pread(fd, data_ + offset, std::min(options.read_size, size_ - offset), static_cast<off_t>(offset));
+    if (count < 0 and errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      release_and_fail("Could not read " + filename, count == 0 ? EIO : errno);
+    }
+    offset += static_cast<size_t>(count);
+  }
+  mprotect(address, mapped_size, PROT_READ);
+}
+
+File::~File() { release(); }
+
+File::File(File &&other) noexcept
+    : fd{std::exchange(other.fd, -1)}, data_{std::exchange(other.data_, nullptr)}, size_{std::exchange(other.size_, 0)},
+      mapped_size{std::exchange(other.mapped_size, 0)}, drop_cache{other.drop_cache}, reader{std::move(other.reader)} {}
+
+File &File::operator=(File &&other) noexcept {
+  if (this != &other) {
+    release();
+    fd = std::exchange(other.fd, -1);
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    mapped_size = std::exchange(other.mapped_size, 0);
+    drop_cache = other.drop_cache;
+    reader = std::move(other.reader);
+  }
+  return *this;
+}
+
+size_t File::wait(size_t size) const { return reader ? reader->wait(size) : size_; }
+
+void File::discard(size_t size) {
+  auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  auto length = std::min(size, size_) / page_size * page_size;
+  if (length == 0) {
+    return;
+  }
+  // Asynchronous reads must be done with the pages before they are dropped.
+  wait(length);
+  madvise(data_, length, MADV_DONTNEED);
+}
+
+void File::release() {
+  // Reads still in flight write into the buffer, so they are finished first.
+  reader.reset();
+  if (data_) {
+    munmap(data_, mapped_size);
+    data_ = nullptr;
+  }
+  if (fd >= 0) {
+    if (drop_cache) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+    fd = -1;
+  }
+  size_ = 0;
+  mapped_size = 0;
+}
+
+void evict(const std::string &filename) {
+  auto fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fail("Could not open " + filename);
+  }
+  fdatasync(fd);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+}
+
+} // namespace otb
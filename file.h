@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace otb {
+
+enum class IoStrategy {
+  // Map the file; pages are read as they are first touched.
+  MMAP,
+  // Read the whole file into an anonymous buffer with large sequential reads.
+  PREAD,
+  // Like PREAD, but the reads are asynchronous (io_uring, or a pool of pread threads) and the tree scan follows them as they complete.
+  ASYNC,
+};
+
+class ChunkReader;
+
+struct IoOptions {
+  IoStrategy strategy = IoStrategy::MMAP;
+  // Fault every page in before returning (MAP_POPULATE).
+  bool populate = false;
+  // Tell the kernel the file is read front to back and needed soon (MADV_SEQUENTIAL, MADV_WILLNEED).
+  bool sequential = false;
+  // Ask for transparent huge pages. File mappings only get them on kernels and file systems that support it; PREAD buffers usually do.
+  bool huge_pages = false;
+  // Evict the file from the page cache when it is released, for files read once at startup.
+  bool drop_cache = false;
+  // Size of each read for PREAD and ASYNC.
+  size_t read_size = size_t{8} << 20;
+  // Reads in flight for ASYNC.
+  unsigned queue_depth = 8;
+};
+
+// Read-only contents of a file, mapped or read according to IoOptions. Owns the memory until release() or destruction.
+class File {
+public:
+  explicit File(const std::string &filename, const IoOptions &options = {});
+  ~File();
+
+  File(File &&other) noexcept;
+  File &operator=(File &&other) noexcept;
+  File(const File &) = delete;
+  File &operator=(const File &) = delete;
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+  const char *begin() const { return data_; }
+  const char *end() const { return data_ + size_; }
+
+  // Blocks until the first `size` bytes (or the whole file) are in memory and returns how many are. Only ASYNC files ever block.
+  size_t wait(size_t size) const;
+
+  // Gives back the memory of the first `size` bytes, rounded down to whole pages, which must not be read again. Mapped pages stay in the page
+  // cache but leave the process.
+  void discard(size_t size);
+
+  // Unmaps or frees the contents, invalidating every pointer into them, and applies drop_cache.
+  void release();
+
+private:
+  int fd = -1;
+  char *data_ = nullptr;
+  size_t size_ = 0;
+  // Length of the mapping, rounded up for PREAD buffers.
+  size_t mapped_size = 0;
+  bool drop_cache = false;
+  // Braces rather than `= {}`, which would need ChunkReader complete to destroy a temporary.
+  std::unique_ptr<ChunkReader> reader{};
+};
+
+// Drops a file's clean pages from the page cache, so the next read of it is cold.
+void evict(const std::string &filename);
+
+} // namespace otb
@@ -0,0 +1,33 @@
+#include "grid.h"
+
+#include <algorithm>
+
+namespace otbm {
+
+Grid::Grid(const Map &map) {
+  for (const auto &[coords, tile] : map.tiles()) {
+    if (not tile.ground() and tile.items().empty()) {
+      continue;
+    }
+
+    auto &sector = sectors[key(coords.x, coords.y, coords.z)];
+    auto row = coords.y & SECTOR_MASK;
+    auto bit = 1u << (coords.x & SECTOR_MASK);
+
+    sector.occupied[row] |= bit;
+    auto blocks_projectile = (tile.ground() and tile.ground()->type->block_projectile()) or
+                             std::any_of(tile.items().begin(), tile.items().end(), [](const otb::Item &item) { return item.type->block_projectile(); });
+    if (blocks_projectile) {
+      sector.blocks_projectile[row] |= bit;
+    }
+
+    if (tile.ground() and (tile.flags() & TILESTATE_BLOCKSOLID) == 0) {
+      sector.walkable[row] |= bit;
+      if ((tile.flags() & TILESTATE_BLOCKPATH) == 0) {
+        sector.pathable[row] |= bit;
+      }
+    }
+  }
+}
+
+} // namespace otbm
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "coords.h"
+#include "otbm.h"
+
+#include <array>
+#include <cstdint>
+#include <tsl/robin_map.h>
+
+namespace otbm {
+
+// Packed blocking data of a loaded map, one bit per tile grouped in 32x32 sectors. The grid is immutable once built, so any number of threads may
+// query it concurrently.
+class Grid {
+public:
+  static constexpr auto SECTOR_BITS = 5;
+  static constexpr auto SECTOR_SIZE = 1 << SECTOR_BITS;
+  static constexpr auto SECTOR_MASK = SECTOR_SIZE - 1;
+
+  struct Sector {
+    // Bit x of row y is set when a creature may stand on the tile.
+    std::array<uint32_t, SECTOR_SIZE> walkable = {};
+    // Same as walkable, but also cleared for tiles that block path finding (e.g. magic fields).
+    std::array<uint32_t, SECTOR_SIZE> pathable = {};
+    // Set when any thing on the tile blocks projectiles.
+    std::array<uint32_t, SECTOR_SIZE> blocks_projectile = {};
+    // Set when the tile holds any thing at all.
+    std::array<uint32_t, SECTOR_SIZE> occupied = {};
+  };
+
+  explicit Grid(const Map &map);
+
+  const Sector *sector(uint16_t x, uint16_t y, uint8_t z) const {
+    auto it = sectors.find(key(x, y, z));
+    return it != sectors.end() ? &it->second : nullptr;
+  }
+
+  bool walkable(const Coords &coords) const {
+    auto sector = this->sector(coords.x, coords.y, coords.z);
+    return sector and test(sector->walkable, coords.x, coords.y);
+  }
+
+  static bool test(const std::array<uint32_t, SECTOR_SIZE> &rows, uint16_t x, uint16_t y) { return (rows[y & SECTOR_MASK] >> (x & SECTOR_MASK) & 1) != 0; }
+
+  static constexpr uint32_t key(uint16_t x, uint16_t y, uint8_t z) {
+    return static_cast<uint32_t>(z) << 22 | static_cast<uint32_t>(x >> SECTOR_BITS) << 11 | static_cast<uint32_t>(y >> SECTOR_BITS);
+  }
+
+private:
+  tsl::robin_map<uint32_t, Sector> sectors = {};
+};
+
+} // namespace otbm
@@ -0,0 +1,110 @@
+#include "index.h"
+#include "memory.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace otbm {
+
+void TypeIndex::Builder::merge(Builder &&other) {
+  for (auto it = other.keys.begin(); it != other.keys.end(); ++it) {
+    auto &keys = this->keys[it->first];
+    if (keys.empty()) {
+      keys = std::move(it.value());
+    } else {
+      keys.insert(keys.end(), it.value().begin(), it.value().end());
+    }
+  }
+  other.keys.clear();
+  other.last = last = nullptr;
+}
+
+TypeIndex::TypeIndex(Builder &&builder) {
+  lists.reserve(builder.keys.size());
+  for (auto it = builder.keys.begin(); it != builder.keys.end(); ++it) {
+    auto &keys = it.value();
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    // LEB128 deltas: neighbouring positions on a floor mostly differ by less than 128.
+    auto &list = lists[it->first];
+    list.count = static_cast<uint32_t>(keys.size());
+    uint64_t previous = 0;
+    for (auto key : keys) {
+      auto delta = key - previous;
+      previous = key;
+      while (delta >= 0x80) {
+        list.deltas.push_back(static_cast<uint8_t>(delta | 0x80));
+        delta >>= 7;
+      }
+      list.deltas.push_back(static_cast<uint8_t>(delta));
+    }
+    list.deltas.shrink_to_fit();
+
+    keys = {};
+  }
+  builder.keys.clear();
+  builder.last = nullptr;
+}
+
+template <class F> void TypeIndex::decode(const List &list, F &&fn) const {
+  uint64_t key = 0;
+  auto first = list.deltas.data(), last = first + list.deltas.size();
+  while (first != last) {
+    uint64_t delta = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      auto byte = *first++;
+      delta |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        break;
+      }
+    }
+    key += delta;
+    fn(key);
+  }
+}
+
+std::vector<Coords> TypeIndex::positions(uint16_t server_id) const {
+  std::vector<Coords> out;
+  auto it = lists.find(server_id);
+  if (it != lists.end()) {
+    out.reserve(it->second.count);
+    decode(it->second, [&out](uint64_t key) { out.push_back(coords(key)); });
+  }
+  return out;
+}
+
+template <class Match> std::vector<Coords> TypeIndex::positions(const otbi::Items &items, Match &&match) const {
+  std::vector<uint64_t> keys;
+  for (const auto &[id, list] : lists) {
+    auto type = items.find(id);
+    if (type and match(*type)) {
+      decode(list, [&keys](uint64_t key) { keys.push_back(key); });
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+  std::vector<Coords> out;
+  out.reserve(keys.size());
+  std::transform(keys.begin(), keys.end(), std::back_inserter(out), coords);
+  return out;
+}
+
+std::vector<Coords> TypeIndex::positions(const otbi::Items &items, otb::item_group group) const {
+  return positions(items, [group](const otb::ItemType &type) { return type.group() == group; });
+}
+
+std::vector<Coords> TypeIndex::positions(const otbi::Items &items, otb::item_type type) const {
+  return positions(items, [type](const otb::ItemType &item_type) { return item_type.type() == type; });
+}
+
+size_t TypeIndex::memory_usage() const {
+  auto bytes = otb::memory::used_buckets(lists) + otb::memory::empty_buckets(lists);
+  for (const auto &[id, list] : lists) {
+    bytes += list.deltas.capacity();
+  }
+  return bytes;
+}
+
+} // namespace otbm
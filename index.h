@@ -0,0 +1,102 @@
+#pragma once
+
+#include "coords.h"
+#include "diagnostics.h"
+#include "itemtype.h"
+#include "otbi.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <tsl/robin_map.h>
+#include <vector>
+
+namespace otbm {
+
+struct ItemRef {
+  Coords coords;
+  const otb::Item *item;
+};
+
+// Items carrying an action or unique id, collected while the map is decoded so scripts can be registered without scanning every tile. The
+// references stay valid for as long as the map they were built from and its tiles are left unchanged.
+struct ScriptIndex {
+  tsl::robin_map<uint16_t, std::vector<ItemRef>> action_ids = {};
+  tsl::robin_map<uint16_t, ItemRef> unique_ids = {};
+
+  // Unique ids are meant to be unique across the map; every repeat is reported and the first item keeps the id.
+  void add(const ItemRef &ref, otb::DiagnosticSink &diagnostics) {
+    const auto &item = *ref.item;
+    if (item.action_id != 0) {
+      action_ids[item.action_id].push_back(ref);
+    }
+    if (item.unique_id != 0 and not unique_ids.emplace(item.unique_id, ref).second) {
+      diagnostics.report({otb::Warning::DUPLICATE_UNIQUE_ID, 0, item.type->id(), item.unique_id, ref.coords});
+    }
+  }
+};
+
+// Every position each server id is found at, for queries such as "all depots" that would otherwise scan the whole map. Items inside containers
+// count at the position of the tile. Each list is sorted by floor, x and y, and stored as variable-length deltas.
+class TypeIndex {
+public:
+  // Collects positions in any order. Loads give each decoding thread its own builder and merge them at the end.
+  class Builder {
+  public:
+    void add(uint16_t server_id, const Coords &coords) {
+      if (not last or server_id != last_id) {
+        last_id = server_id;
+        last = &keys[server_id];
+      }
+      last->push_back(key(coords));
+    }
+
+    void merge(Builder &&other);
+
+  private:
+    friend class TypeIndex;
+
+    tsl::robin_map<uint16_t, std::vector<uint64_t>> keys = {};
+    // Tiles are mostly one item over the same ground, so consecutive adds often share an id.
+    uint16_t last_id = 0;
+    std::vector<uint64_t> *last = nullptr;
+  };
+
+  TypeIndex() = default;
+  explicit TypeIndex(Builder &&builder);
+
+  // Number of distinct positions of a server id.
+  size_t count(uint16_t server_id) const {
+    auto it = lists.find(server_id);
+    return it != lists.end() ? it->second.count : 0;
+  }
+
+  // Positions of a server id, in order.
+  std::vector<Coords> positions(uint16_t server_id) const;
+  // Positions of every item type of a group or kind, in order.
+  std::vector<Coords> positions(const otbi::Items &items, otb::item_group group) const;
+  std::vector<Coords> positions(const otbi::Items &items, otb::item_type type) const;
+
+  // Bytes held by the compressed lists.
+  size_t memory_usage() const;
+
+private:
+  struct List {
+    uint32_t count = 0;
+    std::vector<uint8_t> deltas = {};
+  };
+
+  static constexpr uint64_t key(const Coords &coords) {
+    return static_cast<uint64_t>(coords.z) << 32 | static_cast<uint64_t>(coords.x) << 16 | coords.y;
+  }
+
+  static constexpr Coords coords(uint64_t key) {
+    return {static_cast<uint16_t>(key >> 16), static_cast<uint16_t>(key), static_cast<uint8_t>(key >> 32)};
+  }
+
+  template <class F> void decode(const List &list, F &&fn) const;
+  template <class Match> std::vector<Coords> positions(const otbi::Items &items, Match &&match) const;
+
+  tsl::robin_map<uint16_t, List> lists = {};
+};
+
+} // namespace otbm
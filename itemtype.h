@@ -64,12 +64,13 @@ class ItemType {
   };
 
 public:
+  ItemType() = default;
   ItemType(std::string name, std::string description, double weight, uint32_t flags, uint16_t server_id, uint16_t client_id, uint16_t speed, uint16_t max_items,
            uint16_t rotate_to, uint16_t read_only_id, uint16_t max_text_length, uint16_t ware_id, uint16_t light_level, uint16_t light_color,
-           uint8_t always_on_top_order, item_group group, item_type type)
-      : name_{std::move(name)}, description{std::move(description)}, weight{weight}, flags{flags}, server_id{server_id}, client_id{client_id}, speed{speed},
+           uint16_t minimap_color, uint8_t always_on_top_order, item_group group, item_type type)
+      : name_{std::move(name)}, description_{std::move(description)}, weight{weight}, flags{flags}, server_id{server_id}, client_id_{client_id}, speed{speed},
         max_items{max_items}, rotate_to{rotate_to}, read_only_id{read_only_id}, max_text_length{max_text_length}, ware_id{ware_id}, light_level{light_level},
-        light_color{light_color}, always_on_top_order{always_on_top_order}, group{group}, type{type} {}
+        light_color{light_color}, minimap_color_{minimap_color}, always_on_top_order_{always_on_top_order}, group_{group}, type_{type} {}
 
   auto charges() const { return charges_; }
 
@@ -90,17 +91,27 @@ public:
   bool readable() const { return (flags & READABLE) != 0; }
   bool look_through() const { return (flags & LOOKTHROUGH) != 0; }
   bool is_animation() const { return (flags & ANIMATION) != 0; }
-
-  bool is_ground_tile() const { return group == item_group::GROUND; }
-  bool is_container() const { return group == item_group::CONTAINER; }
-  bool is_splash() const { return group == item_group::SPLASH; }
-  bool is_fluid_container() const { return group == item_group::FLUID; }
+  // Where an item always on top stacks among the others of its tile, lowest first.
+  auto always_on_top_order() const { return always_on_top_order_; }
+
+  bool is_ground_tile() const { return group_ == item_group::GROUND; }
+  bool is_container() const { return group_ == item_group::CONTAINER; }
+  bool is_splash() const { return group_ == item_group::SPLASH; }
+  bool is_fluid_container() const { return group_ == item_group::FLUID; }
+  auto group() const { return group_; }
+  auto type() const { return type_; }
+  // Index into the client's minimap palette, 0 for none.
+  auto minimap_color() const { return minimap_color_; }
 
   auto id() const { return server_id; }
+  // Sprite id shown by clients, 0 for none.
+  auto client_id() const { return client_id_; }
 
   void name(std::string name) { name_ = std::move(name); }
   auto &name() const { return name_; }
 
+  auto &description() const { return description_; }
+
   void article(std::string article) { article_ = std::move(article); }
   auto &article() const { return article_; }
 
@@ -108,38 +119,52 @@ public:
   auto &plural_name() const { return plural_name_; }
 
 private:
-  std::string name_;
-  std::string description;
+  std::string name_ = {};
+  std::string description_ = {};
   std::string article_ = {};
   std::string plural_name_ = {};
 
-  double weight;
+  double weight = 0;
 
-  uint32_t flags;
+  uint32_t flags = 0;
   uint16_t charges_ = 0;
 
-  uint16_t server_id;
-  uint16_t client_id;
-  uint16_t speed;
-  uint16_t max_items;
-  uint16_t rotate_to;
-  uint16_t read_only_id;
-  uint16_t max_text_length;
-  uint16_t ware_id;
-  uint16_t light_level;
-  uint16_t light_color;
-
-  uint8_t always_on_top_order;
-
-  item_group group;
-  item_type type;
+  uint16_t server_id = 0;
+  uint16_t client_id_ = 0;
+  uint16_t speed = 0;
+  uint16_t max_items = 0;
+  uint16_t rotate_to = 0;
+  uint16_t read_only_id = 0;
+  uint16_t max_text_length = 0;
+  uint16_t ware_id = 0;
+  uint16_t light_level = 0;
+  uint16_t light_color = 0;
+  uint16_t minimap_color_ = 0;
+
+  uint8_t always_on_top_order_ = 0;
+
+  item_group group_ = item_group::NONE;
+  item_type type_ = item_type::NONE;
+};
+
+// View of items stored next to each other elsewhere, such as the contents of a container.
+template <class T> struct Span {
+  T *begin() const { return first; }
+  T *end() const { return first + size; }
+  bool empty() const { return size == 0; }
+
+  T *first = nullptr;
+  uint32_t size = 0;
 };
 
 struct Item {
   explicit Item(const ItemType *type) : type{type}, charges{type->charges()} {}
 
-  Item(const Item&) = default;
-  Item& operator=(const Item&) = default;
+  Item(const Item &) = default;
+  Item &operator=(const Item &) = default;
+  // Moving keeps tiles and containers from copying every string and attribute table of an item as it is placed.
+  Item(Item &&) = default;
+  Item &operator=(Item &&) = default;
 
   void subtype(uint8_t value) {
     if (type->is_fluid_container() or type->is_splash()) {
@@ -154,6 +179,8 @@ struct Item {
   using attribute = std::variant<std::string, int64_t, double, bool>;
 
   const ItemType *type;
+  // Items inside this one, owned by the ItemPool of the map it was loaded with.
+  Span<Item> contents = {};
   tsl::robin_map<std::string, attribute> custom_attributes = {};
   std::string text = {};
   std::string writer = {};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "itemtype.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Memory accounting helpers. Figures are derived from sizes and capacities, not measured, so they are what the containers asked the allocator
+// for, without allocator overhead.
+namespace otb::memory {
+
+// Heap bytes of a string; short strings living in the object itself have none.
+inline size_t string_bytes(const std::string &string) {
+  auto object = reinterpret_cast<const char *>(&string);
+  auto data = string.data();
+  return data >= object and data < object + sizeof(string) ? 0 : string.capacity() + 1;
+}
+
+// tsl::robin_map buckets hold a 16-bit probe distance and a flag ahead of the value, padded to its alignment.
+template <class Table> constexpr size_t bucket_size() {
+  using value_type = typename Table::value_type;
+  constexpr auto header = (sizeof(int16_t) + sizeof(bool) + alignof(value_type) - 1) / alignof(value_type) * alignof(value_type);
+  return header + sizeof(value_type);
+}
+
+template <class Table> size_t used_buckets(const Table &table) { return table.size() * bucket_size<Table>(); }
+template <class Table> size_t empty_buckets(const Table &table) { return (table.bucket_count() - table.size()) * bucket_size<Table>(); }
+
+inline size_t attribute_bytes(const Item::attribute &attribute) {
+  auto string = std::get_if<std::string>(&attribute);
+  return string ? string_bytes(*string) : 0;
+}
+
+// Heap bytes of an item's strings, and of its custom attribute table with its keys and values.
+inline size_t item_string_bytes(const Item &item) {
+  return string_bytes(item.text) + string_bytes(item.writer) + string_bytes(item.description) + string_bytes(item.name) + string_bytes(item.article) +
+         string_bytes(item.plural_name);
+}
+
+inline size_t item_attribute_bytes(const Item &item) {
+  if (item.custom_attributes.empty()) {
+    return 0;
+  }
+  auto bytes = used_buckets(item.custom_attributes) + empty_buckets(item.custom_attributes);
+  for (const auto &[key, value] : item.custom_attributes) {
+    bytes += string_bytes(key) + attribute_bytes(value);
+  }
+  return bytes;
+}
+
+} // namespace otb::memory
@@ -0,0 +1,173 @@
+#include "minimap.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <ostream>
+#include <vector>
+
+namespace otbm {
+
+namespace {
+
+constexpr uint32_t CHUNK_SIZE = 256;
+
+// The client palette is a 6x6x6 color cube; 0 is used for "no color" and left transparent.
+constexpr std::array<std::array<uint8_t, 4>, 256> make_palette() {
+  std::array<std::array<uint8_t, 4>, 256> palette = {};
+  for (uint32_t color = 1; color < 216; ++color) {
+    palette[color] = {static_cast<uint8_t>(color / 36 * 51), static_cast<uint8_t>(color / 6 % 6 * 51), static_cast<uint8_t>(color % 6 * 51), 0xFF};
+  }
+  for (uint32_t color = 216; color < 256; ++color) {
+    palette[color] = {0, 0, 0, 0xFF};
+  }
+  return palette;
+}
+
+constexpr auto PALETTE = make_palette();
+
+void extend(std::optional<Rect> &bounds, uint16_t x, uint16_t y) {
+  if (not bounds) {
+    bounds = Rect{x, y, x, y};
+    return;
+  }
+  bounds->x0 = std::min(bounds->x0, x);
+  bounds->y0 = std::min(bounds->y0, y);
+  bounds->x1 = std::max(bounds->x1, x);
+  bounds->y1 = std::max(bounds->y1, y);
+}
+
+// Renders `area` a band of CHUNK_SIZE rows at a time. `chunks` holds the (row, column) of every chunk that may have colors, and
+// `chunk_colors(column, row)` returns the color of any (x, y) in that chunk.
+template <class ChunkColors>
+void render_bands(std::vector<std::pair<uint32_t, uint32_t>> chunks, const Rect &area, MinimapSink &sink, unsigned threads, ChunkColors &&chunk_colors) {
+  auto width = uint32_t{area.x1} - area.x0 + 1;
+  auto height = uint32_t{area.y1} - area.y0 + 1;
+  sink.begin(width, height);
+
+  std::sort(chunks.begin(), chunks.end());
+  std::vector<uint8_t> colors(size_t{width} * CHUNK_SIZE);
+  std::vector<uint8_t> rgba(colors.size() * 4);
+
+  auto next = chunks.begin();
+  for (auto band = uint32_t{area.y0} / CHUNK_SIZE; band <= uint32_t{area.y1} / CHUNK_SIZE; ++band) {
+    auto y0 = std::max(band * CHUNK_SIZE, uint32_t{area.y0});
+    auto y1 = std::min(band * CHUNK_SIZE + CHUNK_SIZE - 1, uint32_t{area.y1});
+    auto pixels = size_t{width} * (y1 - y0 + 1);
+    std::fill_n(colors.begin(), pixels, 0);
+
+    auto first = std::find_if(next, chunks.end(), [band](const auto &chunk) { return chunk.first >= band; });
+    next = std::find_if(first, chunks.end(), [band](const auto &chunk) { return chunk.first > band; });
+    otb::parallel_for(static_cast<size_t>(next - first), threads, [&](size_t i) {
+      auto column = first[i].second;
+      auto x0 = std::max(column * CHUNK_SIZE, uint32_t{area.x0});
+      auto x1 = std::min(column * CHUNK_SIZE + CHUNK_SIZE - 1, uint32_t{area.x1});
+      auto color = chunk_colors(column, band);
+      for (auto y = y0; y <= y1; ++y) {
+        auto row = colors.data() + size_t{y - y0} * width;
+        for (auto x = x0; x <= x1; ++x) {
+          row[x - area.x0] = color(static_cast<uint16_t>(x), static_cast<uint16_t>(y));
+        }
+      }
+    });
+
+    for (size_t i = 0; i < pixels; ++i) {
+      std::memcpy(&rgba[i * 4], PALETTE[colors[i]].data(), 4);
+    }
+    sink.rows(y0 - area.y0, y1 - y0 + 1, rgba.data());
+  }
+}
+
+} // namespace
+
+uint8_t minimap_color(const Tile &tile) {
+  const auto &items = tile.items();
+  for (auto it = items.rbegin(); it != items.rend(); ++it) {
+    if (auto color = it->type->minimap_color()) {
+      return static_cast<uint8_t>(color);
+    }
+  }
+  return tile.ground() ? static_cast<uint8_t>(tile.ground()->type->minimap_color()) : 0;
+}
+
+void PamWriter::begin(uint32_t width, uint32_t height) {
+  this->width = width;
+  out << "P7\nWIDTH " << width << "\nHEIGHT " << height << "\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\nENDHDR\n";
+}
+
+void PamWriter::rows(uint32_t, uint32_t count, const uint8_t *rgba) {
+  out.write(reinterpret_cast<const char *>(rgba), static_cast<std::streamsize>(size_t{count} * width * 4));
+}
+
+void render_minimap(const Map &map, uint8_t z, MinimapSink &sink, const MinimapOptions &options) {
+  // One pass over the tiles finds the chunks of the floor that hold any, and the floor's bounds.
+  std::bitset<CHUNK_SIZE * CHUNK_SIZE> occupied;
+  std::optional<Rect> bounds;
+  for (const auto &[coords, tile] : map.tiles()) {
+    if (coords.z == z) {
+      occupied.set(coords.y / CHUNK_SIZE * CHUNK_SIZE + coords.x / CHUNK_SIZE);
+      extend(bounds, coords.x, coords.y);
+    }
+  }
+
+  auto area = options.area ? options.area : bounds;
+  if (not area) {
+    sink.begin(0, 0);
+    return;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> chunks;
+  for (uint32_t i = 0; i < occupied.size(); ++i) {
+    if (occupied[i]) {
+      chunks.emplace_back(i / CHUNK_SIZE, i % CHUNK_SIZE);
+    }
+  }
+
+  const auto &tiles = map.tiles();
+  render_bands(std::move(chunks), *area, sink, options.threads, [&tiles, z](uint32_t, uint32_t) {
+    return [&tiles, z](uint16_t x, uint16_t y) -> uint8_t {
+      auto it = tiles.find({x, y, z});
+      return it != tiles.end() ? minimap_color(it->second) : 0;
+    };
+  });
+}
+
+void MinimapCollector::add(const Coords &coords, const Tile &tile) {
+  if (coords.z >= MAP_MAX_LAYERS) {
+    return;
+  }
+  extend(bounds[coords.z], coords.x, coords.y);
+
+  if (auto color = minimap_color(tile)) {
+    auto &chunk = chunks[chunk_key(coords.x, coords.y, coords.z)];
+    if (not chunk) {
+      chunk = std::make_unique<Chunk>();
+      chunk->fill(0);
+    }
+    (*chunk)[(coords.y % CHUNK_SIZE) * CHUNK_SIZE + coords.x % CHUNK_SIZE] = color;
+  }
+}
+
+void MinimapCollector::render(uint8_t z, MinimapSink &sink, const MinimapOptions &options) const {
+  auto area = options.area ? options.area : z < MAP_MAX_LAYERS ? bounds[z] : std::nullopt;
+  if (not area) {
+    sink.begin(0, 0);
+    return;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> floor_chunks;
+  for (const auto &[key, chunk] : chunks) {
+    if (key >> 16 == z) {
+      floor_chunks.emplace_back(key & 0xFF, key >> 8 & 0xFF);
+    }
+  }
+
+  render_bands(std::move(floor_chunks), *area, sink, options.threads, [this, z](uint32_t column, uint32_t row) {
+    auto it = chunks.find(chunk_key(static_cast<uint16_t>(column * CHUNK_SIZE), static_cast<uint16_t>(row * CHUNK_SIZE), z));
+    const Chunk *chunk = it != chunks.end() ? it->second.get() : nullptr;
+    return [chunk](uint16_t x, uint16_t y) -> uint8_t { return chunk ? (*chunk)[(y % CHUNK_SIZE) * CHUNK_SIZE + x % CHUNK_SIZE] : 0; };
+  });
+}
+
+} // namespace otbm
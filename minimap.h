@@ -0,0 +1,69 @@
+#pragma once
+
+#include "coords.h"
+#include "otbm.h"
+
+#include <array>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <optional>
+#include <tsl/robin_map.h>
+
+namespace otbm {
+
+// Minimap color of a tile: that of its topmost item having one, else the ground's. 0 means none.
+uint8_t minimap_color(const Tile &tile);
+
+// Receives a minimap image: its size first, then bands of rows from top to bottom, 4 bytes (RGBA) per pixel.
+class MinimapSink {
+public:
+  virtual ~MinimapSink() = default;
+  virtual void begin(uint32_t width, uint32_t height) = 0;
+  virtual void rows(uint32_t y, uint32_t count, const uint8_t *rgba) = 0;
+};
+
+// Writes the image as a PAM file (netpbm, RGB_ALPHA), which keeps the format raw while most image tools can still read it.
+class PamWriter final : public MinimapSink {
+public:
+  explicit PamWriter(std::ostream &out) : out{out} {}
+
+  void begin(uint32_t width, uint32_t height) override;
+  void rows(uint32_t y, uint32_t count, const uint8_t *rgba) override;
+
+private:
+  std::ostream &out;
+  uint32_t width = 0;
+};
+
+struct MinimapOptions {
+  // Part of the floor to render; the bounds of the floor's tiles when unset.
+  std::optional<Rect> area = {};
+  // Threads rendering each band (0 uses every hardware thread).
+  unsigned threads = 0;
+};
+
+// Renders floor `z` one pixel per tile, transparent where there is no color. The image is produced in bands of 256 rows, whose 256x256
+// chunks holding tiles are rendered in parallel, so memory stays at one band (width x 256 pixels) however large the map.
+void render_minimap(const Map &map, uint8_t z, MinimapSink &sink, const MinimapOptions &options = {});
+
+// Collects the minimap colors of tiles as a map is decoded, to render minimaps without keeping the tiles: hand add() to
+// LoadOptions::tile_visitor and turn keep_tiles off. Keeps one byte per position of every 256x256 chunk holding colored tiles.
+class MinimapCollector {
+public:
+  void add(const Coords &coords, const Tile &tile);
+  void render(uint8_t z, MinimapSink &sink, const MinimapOptions &options = {}) const;
+
+private:
+  using Chunk = std::array<uint8_t, 256 * 256>;
+
+  static constexpr uint32_t chunk_key(uint16_t x, uint16_t y, uint8_t z) {
+    return static_cast<uint32_t>(z) << 16 | static_cast<uint32_t>(x >> 8) << 8 | static_cast<uint32_t>(y >> 8);
+  }
+
+  tsl::robin_map<uint32_t, std::unique_ptr<Chunk>> chunks = {};
+  // Bounds of the tiles of each floor.
+  std::array<std::optional<Rect>, MAP_MAX_LAYERS> bounds = {};
+};
+
+} // namespace otbm
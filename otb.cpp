@@ -1,10 +1,27 @@
 #include "otb.h"
 
 #include <stack>
+#include <stdexcept>
 #include <string>
 
 namespace otb {
 
+node::~node() {
+  // Descendants are torn down from a flat list, so deeply nested items cannot exhaust the stack.
+  if (children.empty()) {
+    return;
+  }
+  auto pending = std::move(children);
+  while (not pending.empty()) {
+    auto last = std::move(pending.back());
+    pending.pop_back();
+    for (auto &child : last.children) {
+      pending.push_back(std::move(child));
+    }
+    last.children.clear();
+  }
+}
+
 namespace {
 
 const auto wildcard_identifier = std::string_view{"\0\0\0\0", 4};
@@ -14,11 +31,15 @@ auto check_identifier(iterator it, std::string_view accepted_identifier) {
   return identifier == accepted_identifier or identifier == wildcard_identifier;
 }
 
-auto parse_tree(iterator first, const iterator last) {
+// `file` is consulted for how much of it has been read, so the scan can follow asynchronous reads.
+auto parse_tree(const File &file, iterator first, const iterator last, LoadStats *stats) {
   if (*first != detail::START) {
     throw std::invalid_argument("Invalid first byte.");
   }
 
+  auto scan_begin = first;
+  uint64_t nodes = 1, escapes = 0;
+
   ++first;
   auto root = node{*first, first + sizeof(node::type)};
   auto parse_stack = std::stack<node *, std::vector<node *>>{{&root}};
@@ -30,26 +51,106 @@ auto parse_tree(iterator first, const iterator last) {
     return *parse_stack.top();
   };
 
-  for (; first != last; ++first) {
+  while (first < last) {
+    // One byte of look-ahead is kept for node starts and escapes, unless the end of the file has been read.
+    auto ready = file.begin() + file.wait(static_cast<size_t>(first - file.begin()) + 2);
+    auto limit = ready == last ? last : ready - 1;
+
+    for (; first < limit; ++first) {
+      switch (*first) {
+      case detail::START: {
+        auto &node = get_current();
+        if (node.children.empty()) {
+          node.props_end = first;
+        }
+        if (++first == last) {
+          throw std::invalid_argument("File overflow on start node.");
+        }
+        auto &child = node.children.emplace_back(*first, first + sizeof(node::type));
+        parse_stack.push(&child);
+        ++nodes;
+        break;
+      }
+      case detail::END: {
+        auto &node = get_current();
+        if (node.children.empty()) {
+          node.props_end = first;
+        }
+        node.node_end = first;
+        parse_stack.pop();
+        break;
+      }
+      case detail::ESCAPE:
+        if (++first == last) {
+          throw std::invalid_argument("File overflow on escape node.");
+        }
+        ++escapes;
+        break;
+      }
+    }
+  }
+
+  if (stats) {
+    stats->bytes_scanned += static_cast<uint64_t>(last - scan_begin);
+    stats->escape_bytes += escapes;
+    stats->nodes += nodes;
+  }
+  return root;
+}
+
+} // namespace
+
+iterator check_header(const File &file, std::string_view accepted_identifier) {
+  if (file.wait(6) < 6 or not check_identifier(file.begin(), accepted_identifier)) {
+    throw std::invalid_argument("Invalid magic header.");
+  }
+  return file.begin() + 4;
+}
+
+iterator find_props_end(iterator first, const iterator last) {
+  for (; first < last; ++first) {
+    if (*first == detail::START or *first == detail::END) {
+      return first;
+    }
+    if (*first == detail::ESCAPE and ++first == last) {
+      break;
+    }
+  }
+  throw std::invalid_argument("File overflow in node properties.");
+}
+
+node parse_node(iterator &first, const iterator last) {
+  if (last - first < 2 or *first != detail::START) {
+    throw std::invalid_argument("Invalid node start.");
+  }
+
+  ++first;
+  auto root = node{*first, first + sizeof(node::type)};
+  auto parse_stack = std::vector<node *>{&root};
+  for (++first; first < last; ++first) {
     switch (*first) {
     case detail::START: {
-      auto &node = get_current();
-      if (node.children.empty()) {
-        node.props_end = first;
+      auto &parent = *parse_stack.back();
+      if (parent.children.empty()) {
+        parent.props_end = first;
       }
       if (++first == last) {
         throw std::invalid_argument("File overflow on start node.");
       }
-      auto &child = node.children.emplace_back(*first, first + sizeof(node::type));
-      parse_stack.push(&child);
+      parse_stack.push_back(&parent.children.emplace_back(*first, first + sizeof(node::type)));
       break;
     }
     case detail::END: {
-      auto &node = get_current();
+      auto &node = *parse_stack.back();
       if (node.children.empty()) {
         node.props_end = first;
       }
-      parse_stack.pop();
+      node.node_end = first;
+      parse_stack.pop_back();
+      if (parse_stack.empty()) {
+        ++first;
+        return root;
+      }
       break;
     }
     case detail::ESCAPE:
@@ -59,20 +160,20 @@ auto parse_tree(iterator first, const iterator last) {
       break;
     }
   }
-
-  return root;
+  throw std::invalid_argument("File overflow in node.");
 }
 
-} // namespace
-
-OTB load(std::string_view filename, std::string_view identifier) {
-  auto file = mapped_file{std::string{filename}};
+OTB load(std::string_view filename, std::string_view identifier, const LoadOptions &options) {
+  auto timer = PhaseTimer{options.stats ? &options.stats->map_file : nullptr};
+  auto file = File{std::string{filename}, options.io};
+  timer.stop();
 
-  if (not check_identifier(file.begin(), identifier)) {
-    throw std::invalid_argument("Invalid magic header.");
-  }
+  auto first = check_header(file, identifier);
 
-  return {file, parse_tree(file.begin() + 4, file.end())};
+  auto scan_timer = PhaseTimer{options.stats ? &options.stats->tree_scan : nullptr};
+  auto root = parse_tree(file, first, file.end(), options.stats);
+  scan_timer.stop();
+  return {std::move(file), std::move(root)};
 }
 
 } // namespace otb
@@ -1,13 +1,15 @@
 #pragma once
 
-#include <boost/iostreams/device/mapped_file.hpp>
+#include "diagnostics.h"
+#include "file.h"
+#include "stats.h"
+
 #include <string_view>
 #include <vector>
 
 namespace otb {
 
-using mapped_file = boost::iostreams::mapped_file_source;
-using iterator = mapped_file::iterator;
+using iterator = const char *;
 
 namespace detail {
 
@@ -18,29 +20,55 @@ constexpr char END = '\xFF';
 } // namespace detail
 
 struct node {
-  node(char type, iterator props_begin) : props_begin{props_begin}, props_end{}, type{type} {}
+  node(char type, iterator props_begin) : props_begin{props_begin}, props_end{}, node_end{}, type{type} {}
 
-  node(const node&) = default;
-  node& operator=(const node&) = default;
+  node(const node &) = default;
+  node &operator=(const node &) = default;
+  node(node &&) noexcept = default;
+  node &operator=(node &&) noexcept = default;
+  ~node();
 
   std::vector<node> children = {};
   iterator props_begin, props_end;
+  // The node's END byte, so [props_begin, node_end) spans its properties and every descendant.
+  iterator node_end;
   char type;
 };
 
 class OTB {
 public:
-  OTB(const mapped_file &file, node root) : file{file}, root{std::move(root)} {}
+  OTB(File file, node root) : file{std::move(file)}, root{std::move(root)} {}
 
+  // Start of the file, to turn iterators into byte offsets.
+  auto data() const { return file.data(); }
   const auto &children() const { return root.children; }
   const auto &begin() const { return root.props_begin; }
   const auto &end() const { return root.props_end; }
 
+  // Gives the file contents back once decoding is done; every node and iterator is invalid afterwards.
+  void release() { file.release(); }
+
 private:
-  mapped_file file;
+  File file;
   node root;
 };
 
-OTB load(std::string_view filename, std::string_view accepted_identifier);
+struct LoadOptions {
+  // Receives timings and counters of the load when set.
+  LoadStats *stats = nullptr;
+  // Receives warnings found while decoding. When unset, the loader collects them itself and prints a summary at the end.
+  DiagnosticSink *diagnostics = nullptr;
+  // How the file is brought into memory.
+  IoOptions io = {};
+};
+
+OTB load(std::string_view filename, std::string_view accepted_identifier, const LoadOptions &options = {});
+
+// For reading a file a node at a time rather than scanning it whole. check_header checks the identifier of a file and returns where its root
+// node starts. find_props_end returns where the properties starting at `first` end, at the next START or END byte that is not escaped.
+// parse_node scans the node whose START byte is at `first` with every descendant, and leaves `first` past its END byte.
+iterator check_header(const File &file, std::string_view accepted_identifier);
+iterator find_props_end(iterator first, const iterator last);
+node parse_node(iterator &first, const iterator last);
 
 } // namespace otb
@@ -1,8 +1,13 @@
 #include "otbi.h"
 #include "itemtype.h"
+#include "memory.h"
+#include "parallel.h"
+#include "schema.h"
 #include "stream.h"
 
+#include <algorithm>
 #include <fmt/format.h>
+#include <limits>
 
 namespace otbi {
 
@@ -75,7 +80,7 @@ auto type_from_group(otb::item_group group) {
     return item_type::NONE;
 
   default:
-    throw std::invalid_argument(fmt::format("Invalid item group: {:d}", group));
+    throw std::invalid_argument(fmt::format("Invalid item group: {:d}", static_cast<int>(group)));
   }
 }
 
@@ -93,10 +98,147 @@ auto read_version(otb::iterator &first, const otb::iterator &last) {
   return std::make_pair(major, minor);
 }
 
+struct Properties {
+  otb::DiagnosticSink &diagnostics;
+  std::string name = {};
+  std::string description = {};
+  double weight = 0;
+  uint16_t server_id = 0;
+  uint16_t client_id = 0;
+  uint16_t speed = 0;
+  uint16_t max_items = 0;
+  uint16_t rotate_to = 0;
+  uint16_t read_only_id = 0;
+  uint16_t max_text_length = 0;
+  uint16_t ware_id = 0;
+  uint16_t light_level = 0;
+  uint16_t light_color = 0;
+  uint16_t minimap_color = 0;
+  uint8_t always_on_top_order = 0;
+};
+
+bool skip_payload(otb::iterator &first, const otb::iterator &last, uint16_t length) { return try_skip(first, last, length); }
+
+bool decode_server_id(Properties &properties, otb::iterator &first, const otb::iterator &last, uint16_t length) {
+  static constexpr auto ID_RESERVED = 30000;
+  static constexpr auto ID_RESERVED_SIZE = 100;
+  auto server_id = uint16_t{0};
+  if (not otb::schema::valid_length<uint16_t>(length) or not try_read(first, last, server_id)) {
+    return false;
+  }
+  if (server_id > ID_RESERVED and server_id < ID_RESERVED + ID_RESERVED_SIZE) {
+    server_id -= ID_RESERVED;
+  }
+  properties.server_id = server_id;
+  return true;
+}
+
+template <std::string Properties::*Member, otb::Warning Warning>
+bool decode_text(Properties &properties, otb::iterator &first, const otb::iterator &last, uint16_t length) {
+  constexpr auto MAX_TEXT_LENGTH = 128;
+  if (length >= MAX_TEXT_LENGTH) {
+    properties.diagnostics.report({Warning, 0, properties.server_id, length});
+  }
+  return try_read_string(first, last, length, properties.*Member);
+}
+
+template <uint16_t Properties::*First, uint16_t Properties::*Second, uint8_t Id>
+bool decode_pair(Properties &properties, otb::iterator &first, const otb::iterator &last, uint16_t length) {
+  return otb::schema::valid_length<uint32_t>(length) and try_read(first, last, properties.*First) and try_read(first, last, properties.*Second);
+}
+
+namespace item_type_schema {
+
+using namespace otb::schema;
+using P = Properties;
+
+using decoder = otb::schema::decoder<framing::LENGTH_PREFIXED, Properties,
+                                     custom<ITEM_ATTR_SERVERID, decode_server_id, skip_payload>,
+                                     value<ITEM_ATTR_CLIENTID, &P::client_id>,
+                                     custom<ITEM_ATTR_NAME, decode_text<&P::name, otb::Warning::LONG_ITEM_NAME>, skip_payload>,
+                                     custom<ITEM_ATTR_DESCR, decode_text<&P::description, otb::Warning::LONG_ITEM_DESCRIPTION>, skip_payload>,
+                                     value<ITEM_ATTR_SPEED, &P::speed>,
+                                     value<ITEM_ATTR_MAXITEMS, &P::max_items>,
+                                     value<ITEM_ATTR_WEIGHT, &P::weight>,
+                                     value<ITEM_ATTR_ROTATETO, &P::rotate_to>,
+                                     custom<ITEM_ATTR_LIGHT2, decode_pair<&P::light_level, &P::light_color, ITEM_ATTR_LIGHT2>, skip_payload>,
+                                     value<ITEM_ATTR_TOPORDER, &P::always_on_top_order>,
+                                     custom<ITEM_ATTR_WRITEABLE3, decode_pair<&P::read_only_id, &P::max_text_length, ITEM_ATTR_WRITEABLE3>, skip_payload>,
+                                     value<ITEM_ATTR_WAREID, &P::ware_id>,
+                                     value<ITEM_ATTR_MINIMAPCOLOR, &P::minimap_color>,
+                                     // not implemented
+                                     ignore<ITEM_ATTR_SPRITEHASH>,
+                                     ignore<ITEM_ATTR_07>,
+                                     ignore<ITEM_ATTR_08>>;
+
+} // namespace item_type_schema
+
+otb::ItemType decode_item(const otb::node &item_node, otb::DiagnosticSink &diagnostics) {
+  auto node_begin = item_node.props_begin;
+  const auto node_end = item_node.props_end;
+
+  auto flags = read<uint32_t>(node_begin, node_end);
+
+  auto properties = Properties{diagnostics};
+  while (node_begin != node_end) {
+    auto attr = read<uint8_t>(node_begin, node_end);
+    auto length = read<uint16_t>(node_begin, node_end);
+
+    auto result = item_type_schema::decoder::decode(attr, properties, node_begin, node_end, length);
+    if (result == otb::schema::result::INVALID) {
+      throw std::invalid_argument(fmt::format("Invalid attribute {:d} of length {:d} (sid {:d})", attr, length, properties.server_id));
+    }
+    if (result == otb::schema::result::UNKNOWN) {
+      diagnostics.report({otb::Warning::UNKNOWN_ITEM_TYPE_ATTRIBUTE, attr, properties.server_id, length});
+      // skip unknown attributes
+      skip(node_begin, node_end, length);
+    }
+  }
+
+  auto group = static_cast<otb::item_group>(item_node.type);
+  auto type = type_from_group(group);
+
+  auto &p = properties;
+  return {std::move(p.name), std::move(p.description), p.weight, flags, p.server_id, p.client_id, p.speed, p.max_items, p.rotate_to, p.read_only_id,
+          p.max_text_length, p.ware_id, p.light_level, p.light_color, p.minimap_color, p.always_on_top_order, group, type};
+}
+
 } // namespace
 
-Items load(std::string_view filename) {
-  auto loader = otb::load(filename, "OTBI");
+Items::Items(std::vector<otb::ItemType> &&types) : types{std::move(types)} {
+  if (this->types.size() >= std::numeric_limits<uint16_t>::max()) {
+    throw std::invalid_argument(fmt::format("Too many item types: {:d}", this->types.size()));
+  }
+
+  uint16_t max_server_id = 0;
+  uint16_t max_client_id = 0;
+  for (const auto &type : this->types) {
+    max_server_id = std::max(max_server_id, type.id());
+    max_client_id = std::max(max_client_id, type.client_id());
+  }
+
+  by_server_id.assign(max_server_id + size_t{1}, 0);
+  by_client_id.assign(max_client_id + size_t{1}, 0);
+  for (size_t i = 0; i < this->types.size(); ++i) {
+    const auto &type = this->types[i];
+    auto slot = static_cast<uint16_t>(i + 1);
+    // Later duplicates are kept in the type list but not reachable by id, the first one in the file wins.
+    if (by_server_id[type.id()] == 0) {
+      by_server_id[type.id()] = slot;
+    }
+    if (type.client_id() != 0 and by_client_id[type.client_id()] == 0) {
+      by_client_id[type.client_id()] = slot;
+    }
+  }
+}
+
+Items load(std::string_view filename, const LoadOptions &options) {
+  auto stats = options.stats;
+  auto memory = otb::MemoryScope{stats};
+  auto loader = otb::load(filename, "OTBI", options);
+
+  auto fallback_diagnostics = otb::Diagnostics{};
+  auto &diagnostics = options.diagnostics ? *options.diagnostics : fallback_diagnostics;
 
   auto root_begin = loader.begin();
   const auto root_end = loader.end();
@@ -110,170 +252,52 @@ Items load(std::string_view filename) {
   }
 
   if (major == std::numeric_limits<uint32_t>::max()) {
-    fmt::print("[Warning] items.otb using generic client version.\n");
+    diagnostics.report({otb::Warning::GENERIC_CLIENT_VERSION});
   } else if (major != 3) {
     throw std::invalid_argument("Old version detected, a newer version of items.otb is required.");
   } else if (minor < CLIENT_VERSION_1098) {
     throw std::invalid_argument("A newer version of items.otb is required.");
   }
 
-  auto items = Items{};
-  for (const auto &item_node : loader.children()) {
-    auto node_begin = item_node.props_begin;
-    const auto node_end = item_node.props_end;
-
-    auto flags = read<uint32_t>(node_begin, node_end);
-
-    constexpr auto MAX_TEXT_LENGTH = 128;
-    std::string name;
-    std::string description;
-    double weight = 0;
-    uint16_t server_id = 0;
-    uint16_t client_id = 0;
-    uint16_t speed = 0;
-    uint16_t max_items = 0;
-    uint16_t rotate_to = 0;
-    uint16_t read_only_id = 0;
-    uint16_t max_text_length = 0;
-    uint16_t ware_id = 0;
-    uint16_t light_level = 0;
-    uint16_t light_color = 0;
-    uint8_t always_on_top_order = 0;
-
-    while (node_begin != node_end) {
-      auto attr = read<uint8_t>(node_begin, node_end);
-      auto length = read<uint16_t>(node_begin, node_end);
-
-      switch (attr) {
-      case ITEM_ATTR_SERVERID:
-        if (length != sizeof(uint16_t)) {
-          throw std::invalid_argument(fmt::format("Invalid server ID attribute length: expected {:d}, got {:d}", sizeof(uint16_t), length));
-        }
-
-        static constexpr auto ID_RESERVED = 30000;
-        static constexpr auto ID_RESERVED_SIZE = 100;
-        server_id = read<uint16_t>(node_begin, node_end);
-        if (server_id > ID_RESERVED and server_id < ID_RESERVED + ID_RESERVED_SIZE) {
-          server_id -= ID_RESERVED;
-        }
-        break;
-
-      case ITEM_ATTR_CLIENTID:
-        if (length != sizeof(uint16_t)) {
-          throw std::invalid_argument(fmt::format("Invalid client ID attribute length: expected {:d}, got {:d}", sizeof(uint16_t), length));
-        }
-
-        client_id = read<uint16_t>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_NAME: {
-        if (length >= MAX_TEXT_LENGTH) {
-          fmt::print("[Warning] Unexpected item name length: {:d}", length);
-        }
-
-        name = read_string(node_begin, node_end, length);
-        break;
-      }
-
-      case ITEM_ATTR_DESCR: {
-        if (length >= MAX_TEXT_LENGTH) {
-          fmt::print("[Warning] Unexpected item description length: {:d}", length);
-        }
-
-        description = read_string(node_begin, node_end, length);
-        break;
-      }
-
-      case ITEM_ATTR_SPEED:
-        if (length != sizeof(uint16_t)) {
-          throw std::invalid_argument(fmt::format("Invalid speed attribute length: expected {:d}, got {:d}", sizeof(uint16_t), length));
-        }
-
-        speed = read<uint16_t>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_MAXITEMS:
-        if (length != sizeof(uint16_t)) {
-          throw std::invalid_argument(fmt::format("Invalid max. items attribute length: expected {:d}, got {:d}", sizeof(uint16_t), length));
-        }
-
-        max_items = read<uint16_t>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_WEIGHT:
-        if (length != sizeof(double)) {
-          throw std::invalid_argument(fmt::format("Invalid weight attribute length: expected {:d}, got {:d}", sizeof(double), length));
-        }
-
-        weight = read<double>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_ROTATETO:
-        if (length != sizeof(uint16_t)) {
-          throw std::invalid_argument(fmt::format("Invalid rotate to attribute length: expected {:d}, got {:d}", sizeof(uint16_t), length));
-        }
-
-        rotate_to = read<uint16_t>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_LIGHT2:
-        if (length != 2 * sizeof(uint16_t)) {
-          throw std::invalid_argument(fmt::format("Invalid light2 attribute length: expected {:d}, got {:d}", 2 * sizeof(uint16_t), length));
-        }
-
-        light_level = read<uint16_t>(node_begin, node_end);
-        light_color = read<uint16_t>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_TOPORDER:
-        if (length != sizeof(uint8_t)) {
-          throw std::invalid_argument(fmt::format("Invalid top order attribute length: expected {:d}, got {:d}", sizeof(uint8_t), length));
-        }
-
-        always_on_top_order = read<uint8_t>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_WRITEABLE3:
-        if (length != 2 * sizeof(uint16_t)) {
-          throw std::invalid_argument(fmt::format("Invalid writeable3 attribute length: expected {:d}, got {:d}", 2 * sizeof(uint16_t), length));
-        }
-
-        read_only_id = read<uint16_t>(node_begin, node_end);
-        max_text_length = read<uint16_t>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_WAREID:
-        if (length != sizeof(uint16_t)) {
-          throw std::invalid_argument(fmt::format("Invalid ware ID attribute length: expected {:d}, got {:d}", sizeof(uint16_t), length));
-        }
-
-        ware_id = read<uint16_t>(node_begin, node_end);
-        break;
-
-      case ITEM_ATTR_SPRITEHASH:
-      case ITEM_ATTR_MINIMAPCOLOR:
-      case ITEM_ATTR_07:
-      case ITEM_ATTR_08:
-        // not implemented
-        skip(node_begin, node_end, length);
-        break;
-
-      default:
-        fmt::print("[Warning] Unknown attribute {:d} length {:d} sid {:d} cid {:d}\n", attr, length, server_id, client_id);
-        // skip unknown attributes
-        skip(node_begin, node_end, length);
-        break;
-      }
+  auto decode_timer = otb::PhaseTimer{stats ? &stats->decode : nullptr};
+  const auto &nodes = loader.children();
+  // Item nodes are independent, so blocks of them are decoded in parallel, each into its own slots to keep file order.
+  constexpr size_t BLOCK_SIZE = 256;
+  std::vector<otb::ItemType> types(nodes.size());
+  otb::parallel_for((nodes.size() + BLOCK_SIZE - 1) / BLOCK_SIZE, options.threads, [&](size_t block) {
+    auto last = std::min(nodes.size(), (block + 1) * BLOCK_SIZE);
+    for (auto i = block * BLOCK_SIZE; i < last; ++i) {
+      types[i] = decode_item(nodes[i], diagnostics);
     }
+  });
+  decode_timer.stop();
+  loader.release();
 
-    auto group = static_cast<otb::item_group>(item_node.type);
-    auto type = type_from_group(group);
+  auto insertion_timer = otb::PhaseTimer{stats ? &stats->insertion : nullptr};
+  auto items = Items{std::move(types)};
+  insertion_timer.stop();
 
-    items.emplace(server_id, otb::ItemType{name, description, weight, flags, server_id, client_id, speed, max_items, rotate_to, read_only_id, max_text_length,
-                                           ware_id, light_level, light_color, always_on_top_order, group, type});
+  if (stats) {
+    stats->items += items.size();
+  }
+  if (not options.diagnostics) {
+    fallback_diagnostics.print_summary();
   }
-
   return items;
 }
 
+MemoryUsage memory_usage(const Items &items) {
+  namespace memory = otb::memory;
+
+  MemoryUsage usage;
+  usage.item_types = items.types.size() * sizeof(otb::ItemType);
+  usage.table_slack = (items.types.capacity() - items.types.size()) * sizeof(otb::ItemType);
+  usage.lookup_tables = (items.by_server_id.capacity() + items.by_client_id.capacity()) * sizeof(uint16_t);
+  for (const auto &type : items) {
+    usage.strings += memory::string_bytes(type.name()) + memory::string_bytes(type.description()) + memory::string_bytes(type.article()) +
+                     memory::string_bytes(type.plural_name());
+  }
+  return usage;
+}
+
 } // namespace otbi
@@ -1,15 +1,76 @@
 #pragma once
 
 #include "itemtype.h"
+#include "otb.h"
 
 #include <cstdint>
+#include <stdexcept>
 #include <string>
-#include <tsl/robin_map.h>
+#include <vector>
 
 namespace otbi {
 
-using Items = tsl::robin_map<uint16_t, otb::ItemType>;
+class Items;
 
-Items load(std::string_view filename);
+// Where a loaded item table keeps its memory, in bytes.
+struct MemoryUsage {
+  // The item types themselves.
+  size_t item_types = 0;
+  // Heap storage of names, descriptions, articles and plurals.
+  size_t strings = 0;
+  // Server id and client id tables.
+  size_t lookup_tables = 0;
+  // Unused capacity of the type storage.
+  size_t table_slack = 0;
 
-} // namespace otbi
\ No newline at end of file
+  size_t total() const { return item_types + strings + lookup_tables + table_slack; }
+};
+
+MemoryUsage memory_usage(const Items &items);
+
+// Item types in file order, with dense tables mapping server ids and client ids to them. Types never move once loaded, so Item::type pointers
+// stay valid for the table's lifetime.
+class Items {
+public:
+  Items() = default;
+  explicit Items(std::vector<otb::ItemType> &&types);
+
+  const otb::ItemType *find(uint16_t server_id) const {
+    auto slot = server_id < by_server_id.size() ? by_server_id[server_id] : 0;
+    return slot ? &types[slot - 1u] : nullptr;
+  }
+
+  const otb::ItemType &at(uint16_t server_id) const {
+    if (auto type = find(server_id)) {
+      return *type;
+    }
+    throw std::out_of_range("Unknown server id.");
+  }
+
+  // Type shown to clients as `client_id`; the first in the file when several share it.
+  const otb::ItemType *find_by_client_id(uint16_t client_id) const {
+    auto slot = client_id < by_client_id.size() ? by_client_id[client_id] : 0;
+    return slot ? &types[slot - 1u] : nullptr;
+  }
+
+  size_t size() const { return types.size(); }
+  auto begin() const { return types.begin(); }
+  auto end() const { return types.end(); }
+
+private:
+  friend MemoryUsage memory_usage(const Items &items);
+
+  std::vector<otb::ItemType> types = {};
+  // Position in `types` plus one, 0 for ids without a type.
+  std::vector<uint16_t> by_server_id = {};
+  std::vector<uint16_t> by_client_id = {};
+};
+
+struct LoadOptions : otb::LoadOptions {
+  // Threads decoding item nodes, 0 uses every hardware thread. With more than one, the diagnostics sink must accept concurrent reports.
+  unsigned threads = 0;
+};
+
+Items load(std::string_view filename, const LoadOptions &options = {});
+
+} // namespace otbi
@@ -1,9 +1,15 @@
 #include "otbm.h"
+#include "attributes.h"
+#include "memory.h"
 #include "stream.h"
+#include "topology.h"
 
 #include <fmt/format.h>
+#include <future>
+#include <numeric>
 #include <optional>
 #include <stdexcept>
+#include <thread>
 
 template <> struct fmt::formatter<otbm::Coords> {
   static constexpr auto parse(format_parse_context &ctx) {
@@ -27,46 +33,6 @@ namespace otbm {
 
 namespace {
 
-enum {
-  ATTR_DESCRIPTION = 1,
-  ATTR_EXT_FILE = 2,
-  ATTR_TILE_FLAGS = 3,
-  ATTR_ACTION_ID = 4,
-  ATTR_UNIQUE_ID = 5,
-  ATTR_TEXT = 6,
-  ATTR_DESC = 7,
-  ATTR_TELE_DEST = 8,
-  ATTR_ITEM = 9,
-  ATTR_DEPOT_ID = 10,
-  ATTR_EXT_SPAWN_FILE = 11,
-  ATTR_RUNE_CHARGES = 12,
-  ATTR_EXT_HOUSE_FILE = 13,
-  ATTR_HOUSEDOORID = 14,
-  ATTR_COUNT = 15,
-  ATTR_DURATION = 16,
-  ATTR_DECAYING_STATE = 17,
-  ATTR_WRITTENDATE = 18,
-  ATTR_WRITTENBY = 19,
-  ATTR_SLEEPERGUID = 20,
-  ATTR_SLEEPSTART = 21,
-  ATTR_CHARGES = 22,
-  ATTR_CONTAINER_ITEMS = 23,
-  ATTR_NAME = 24,
-  ATTR_ARTICLE = 25,
-  ATTR_PLURALNAME = 26,
-  ATTR_WEIGHT = 27,
-  ATTR_ATTACK = 28,
-  ATTR_DEFENSE = 29,
-  ATTR_EXTRADEFENSE = 30,
-  ATTR_ARMOR = 31,
-  ATTR_HITCHANCE = 32,
-  ATTR_SHOOTRANGE = 33,
-  ATTR_CUSTOM_ATTRIBUTES = 34,
-  ATTR_DECAYTO = 35,
-  ATTR_WRAPID = 36,
-  ATTR_STOREITEM = 37
-};
-
 enum {
   ITEM_BROWSEFIELD = 460, // for internal use
 
@@ -143,32 +109,6 @@ enum {
   ITEM_DOCUMENT_RO = 1968, // read-only
 };
 
-enum {
-  NODETYPE_ROOTV1 = 1,
-  NODETYPE_MAP_DATA = 2,
-  NODETYPE_ITEM_DEF = 3,
-  NODETYPE_TILE_AREA = 4,
-  NODETYPE_TILE = 5,
-  NODETYPE_ITEM = 6,
-  NODETYPE_TILE_SQUARE = 7,
-  NODETYPE_TILE_REF = 8,
-  NODETYPE_SPAWNS = 9,
-  NODETYPE_SPAWN_AREA = 10,
-  NODETYPE_MONSTER = 11,
-  NODETYPE_TOWNS = 12,
-  NODETYPE_TOWN = 13,
-  NODETYPE_HOUSETILE = 14,
-  NODETYPE_WAYPOINTS = 15,
-  NODETYPE_WAYPOINT = 16,
-};
-
-enum {
-  TILEFLAG_PROTECTIONZONE = 1 << 0,
-  TILEFLAG_NOPVPZONE = 1 << 2,
-  TILEFLAG_NOLOGOUT = 1 << 3,
-  TILEFLAG_PVPZONE = 1 << 4,
-};
-
 uint16_t get_persistent_id(uint16_t id) {
   switch (id) {
   case ITEM_FIREFIELD_PVP_FULL:
@@ -232,276 +172,425 @@ auto parse_map_attributes(const otb::node &node) {
   return out;
 }
 
-struct House {
-  std::vector<Coords> tiles = {};
-};
+// Outcome of decoding a tile or a tile area: the first error met and where, or NONE. Tiles are decoded without throwing, so that a lenient
+// load can skip the broken ones and carry on.
+struct Status {
+  otb::DecodeError error = otb::DecodeError::NONE;
+  otb::iterator at = nullptr;
+  uint8_t attribute = 0;
+  uint16_t item_id = 0;
 
-auto read_coords(otb::iterator &first, const otb::iterator &last) {
-  auto x = read<uint16_t>(first, last);
-  auto y = read<uint16_t>(first, last);
-  auto z = read<uint8_t>(first, last);
-  return Coords{x, y, z};
-}
+  bool ok() const { return error == otb::DecodeError::NONE; }
+};
 
-template <class T> void parse_tile_area(const otb::node &node, const otbi::Items &items, T &&callback) {
-  auto node_begin = node.props_begin;
-  auto area_coords = read_coords(node_begin, node.props_end);
+// An item with an action or unique id, met while decoding. Items of a tile are known by their slot (-1 for the ground) until the tile table
+// stops moving; items inside containers already sit in the pool and are known by address.
+struct IndexedItem {
+  Coords coords = {};
+  int32_t slot = 0;
+  const otb::Item *item = nullptr;
+  // Number of the tile among those decoded, to tell the tile kept at a position from others found there.
+  uint32_t tile = 0;
+};
 
-  tsl::robin_map<uint32_t, House> houses;
-  std::optional<Tile> tile;
-  std::optional<otb::Item> ground_item;
-  for (const auto &tile_node : node.children) {
-    tile.reset();
-    ground_item.reset();
+bool has_script_id(const otb::Item &item) { return item.action_id != 0 or item.unique_id != 0; }
 
-    if (tile_node.type != NODETYPE_TILE and tile_node.type != NODETYPE_HOUSETILE) {
-      throw std::invalid_argument(fmt::format("Unknown tile node: {:d}", tile_node.type));
+// Decodes item nodes, and the items inside them into the pool. Containers are walked with an explicit stack, so nesting depth is only bounded
+// by memory, and the stack and the item being decoded are reused across calls.
+struct ItemDecoder {
+  // Decodes an item node into `item`.
+  Status decode(const otb::node &item_node, const Coords &coords, std::optional<otb::Item> &item) {
+    if (item_node.type != NODETYPE_ITEM) {
+      return {otb::DecodeError::UNKNOWN_NODE_TYPE, item_node.props_begin - 1, static_cast<uint8_t>(item_node.type)};
     }
 
-    auto tile_begin = tile_node.props_begin;
-    auto tile_end = tile_node.props_end;
-    uint16_t x = area_coords.x + read<uint8_t>(tile_begin, tile_end);
-    uint16_t y = area_coords.y + read<uint8_t>(tile_begin, tile_end);
-    uint8_t z = area_coords.z;
-
-    uint32_t house_id = 0;
-    if (tile_node.type == NODETYPE_HOUSETILE) {
-      house_id = read<uint32_t>(tile_begin, tile_end);
-      houses[house_id].tiles.emplace_back(x, y, z);
-    }
-
-    int tile_flags = TILESTATE_NONE;
-    while (tile_begin != tile_end) {
-      switch (auto attr = read<uint8_t>(tile_begin, tile_end)) {
-      case ATTR_TILE_FLAGS: {
-        auto flags = read<uint32_t>(tile_begin, tile_end);
-
-        if (flags & TILEFLAG_PROTECTIONZONE) {
-          tile_flags |= TILESTATE_PROTECTIONZONE;
-        } else if (flags & TILEFLAG_NOPVPZONE) {
-          tile_flags |= TILESTATE_NOPVPZONE;
-        } else if (flags & TILEFLAG_PVPZONE) {
-          tile_flags |= TILESTATE_PVPZONE;
-        }
-
-        if (flags & TILEFLAG_NOLOGOUT) {
-          tile_flags |= TILESTATE_NOLOGOUT;
-        }
+    auto item_begin = item_node.props_begin;
+    auto item_end = item_node.props_end;
+    uint16_t id = 0;
+    if (not try_read(item_begin, item_end, id)) {
+      return {otb::DecodeError::TRUNCATED, item_begin};
+    }
+    id = get_persistent_id(id);
+    auto type = items.find(id);
+    if (not type) {
+      return {otb::DecodeError::UNKNOWN_ITEM_ID, item_node.props_begin, 0, id};
+    }
 
-        break;
+    item.emplace(type);
+    while (item_begin != item_end) {
+      auto attr_at = item_begin;
+      auto attr = uint8_t{0};
+      if (not try_read(item_begin, item_end, attr)) {
+        return {otb::DecodeError::TRUNCATED, item_begin, 0, id};
       }
-
-      case ATTR_ITEM: {
-        auto id = get_persistent_id(read<uint16_t>(tile_begin, tile_end));
-        auto type = items.at(id);
-        auto item = otb::Item{&type};
-
-        if (house_id != 0 and type.moveable()) {
-          fmt::print("[Warning] Moveable item with ID {:d} in house {:d} @ {}.\n", id, house_id, Coords{x, y, z});
-          break;
-        }
-
-        if (tile) {
-          tile->emplace_item(std::move(item));
-        } else if (type.is_ground_tile()) {
-          ground_item.emplace(std::move(item));
-        } else {
-          tile.emplace(*ground_item, tile_flags);
-          ground_item.reset();
-        }
-
-        break;
+      auto result = item_schema::decoder::decode(attr, *item, item_begin, item_end);
+      if (result == otb::schema::result::INVALID) {
+        return {otb::DecodeError::INVALID_ITEM_ATTRIBUTE, item_begin, attr, id};
       }
-
-      default:
-        throw std::invalid_argument(fmt::format("Unknown tile attribute {:d} @ {}", attr, Coords{x, y, z}));
+      if (result == otb::schema::result::UNKNOWN) {
+        // The payload size of an unknown attribute is unknown as well, nothing after it can be trusted.
+        diagnostics.report({otb::Warning::UNKNOWN_ITEM_ATTRIBUTE, attr, id, 0, coords, static_cast<uint64_t>(attr_at - data)});
+        break;
       }
     }
+    return {};
+  }
 
-    for (const auto &item_node : tile_node.children) {
-      if (item_node.type != NODETYPE_ITEM) {
-        throw std::invalid_argument(fmt::format("Unknown node type: {:d}", item_node.type));
+  // Fills the contents of `container` from the children of its node, breadth first: all items of one container are pushed to the pool before
+  // any of their own contents, so each container's items end up next to each other.
+  Status decode_contents(otb::Item &container, const otb::node &container_node, const Coords &coords) {
+    pending.clear();
+    pending.emplace_back(&container, &container_node);
+    while (not pending.empty()) {
+      auto [item, node] = pending.back();
+      pending.pop_back();
+      if (node->children.empty()) {
+        continue;
       }
 
-      auto item_begin = item_node.props_begin;
-      auto item_end = item_node.props_end;
-      auto id = get_persistent_id(read<uint16_t>(item_begin, item_end));
-      auto type = items.at(id);
-      auto item = otb::Item{&type};
-
-      while (item_begin != item_end) {
-        auto attr = read<uint8_t>(item_begin, item_end);
-        switch (attr) {
-        case ATTR_CHARGES:
-        case ATTR_COUNT:
-        case ATTR_RUNE_CHARGES:
-          item.subtype(read<uint8_t>(item_begin, item_end));
-          break;
-
-        case ATTR_ACTION_ID:
-          item.action_id = read<uint16_t>(item_begin, item_end);
-          break;
-
-        case ATTR_UNIQUE_ID:
-          item.unique_id = read<uint16_t>(item_begin, item_end);
-          break;
-
-        case ATTR_TEXT: {
-          auto len = read<uint16_t>(item_begin, item_end);
-          item.text = read_string(item_begin, item_end, len);
-          break;
+      pool.reserve(node->children.size());
+      otb::Item *first = nullptr;
+      for (const auto &child_node : node->children) {
+        std::optional<otb::Item> decoded;
+        if (auto status = decode(child_node, coords, decoded); not status.ok()) {
+          return status;
         }
-
-        case ATTR_WRITTENDATE:
-          item.written_at = read<uint32_t>(item_begin, item_end);
-          break;
-
-        case ATTR_WRITTENBY: {
-          auto len = read<uint16_t>(item_begin, item_end);
-          item.writer = read_string(item_begin, item_end, len);
-          break;
+        auto &child = pool.push(std::move(*decoded));
+        if (types) {
+          tile_types.push_back(child.type->id());
         }
-
-        case ATTR_DESC: {
-          auto len = read<uint16_t>(item_begin, item_end);
-          item.description = read_string(item_begin, item_end, len);
-          break;
+        if (has_script_id(child)) {
+          indexed.push_back({coords, 0, &child, tiles});
         }
+        if (not first) {
+          first = &child;
+        }
+        if (not child_node.children.empty()) {
+          pending.emplace_back(&child, &child_node);
+        }
+      }
+      item->contents = {first, static_cast<uint32_t>(node->children.size())};
+    }
+    return {};
+  }
 
-        case ATTR_DURATION:
-          item.duration = std::max<int32_t>(0, read<int32_t>(item_begin, item_end));
-          break;
-
-        case ATTR_DECAYING_STATE:
-          // TODO
-          read<uint8_t>(item_begin, item_end);
-          break;
+  // Drops what a tile that failed to decode left behind, back to the sizes taken when it started.
+  void rollback(size_t pool_size, size_t indexed_size) {
+    pool.truncate(pool_size);
+    indexed.resize(indexed_size);
+    tile_types.clear();
+  }
 
-        case ATTR_NAME: {
-          auto len = read<uint16_t>(item_begin, item_end);
-          item.name = read_string(item_begin, item_end, len);
-          break;
-        }
+  const otbi::Items &items;
+  otb::DiagnosticSink &diagnostics;
+  otb::ItemPool &pool;
+  // Start of the file, to report byte offsets.
+  otb::iterator data;
+  std::vector<std::pair<otb::Item *, const otb::node *>> pending = {};
+  std::vector<IndexedItem> indexed = {};
+  // Receives the position of every item when the type index is wanted.
+  TypeIndex::Builder *types = nullptr;
+  // Server ids of the container items of the tile being decoded, added to `types` once the tile is complete.
+  std::vector<uint16_t> tile_types = {};
+  // Times the item vector of a tile grew.
+  uint64_t reallocations = 0;
+  // Tiles decoded so far, which numbers the entries of `indexed`.
+  uint32_t tiles = 0;
+};
 
-        case ATTR_ARTICLE: {
-          auto len = read<uint16_t>(item_begin, item_end);
-          item.article = read_string(item_begin, item_end, len);
-          break;
-        }
+// Items a tile will hold besides its ground, inline or as item nodes, read from the attributes in [first, last) that follow its position.
+size_t count_tile_items(const otb::node &tile_node, otb::iterator first, const otb::iterator &last, const otbi::Items &items) {
+  auto held = [&](uint16_t id) {
+    auto type = items.find(get_persistent_id(id));
+    return type and not type->is_ground_tile() ? 1u : 0u;
+  };
+
+  size_t count = 0;
+  uint8_t attr = 0;
+  uint16_t id = 0;
+  // Broken attributes are reported by the decoder.
+  while (first != last and try_read(first, last, attr)) {
+    if (attr == ATTR_TILE_FLAGS and try_skip(first, last, sizeof(uint32_t))) {
+      continue;
+    }
+    if (attr != ATTR_ITEM or not try_read(first, last, id)) {
+      break;
+    }
+    count += held(id);
+  }
+  for (const auto &item_node : tile_node.children) {
+    auto item_begin = item_node.props_begin;
+    if (item_node.type == NODETYPE_ITEM and try_read(item_begin, item_node.props_end, id)) {
+      count += held(id);
+    }
+  }
+  return count;
+}
 
-        case ATTR_PLURALNAME: {
-          auto len = read<uint16_t>(item_begin, item_end);
-          item.plural_name = read_string(item_begin, item_end, len);
-          break;
-        }
+using HouseTiles = tsl::robin_map<uint32_t, std::vector<Coords>>;
 
-        case ATTR_WEIGHT:
-          item.weight = read<uint32_t>(item_begin, item_end);
-          break;
+// Decodes the attributes and item nodes of a tile, from `tile_begin` past its position, into `tile`.
+Status decode_tile(const otb::node &tile_node, otb::iterator tile_begin, const Coords &coords, uint32_t house_id, ItemDecoder &decoder,
+                   const LoadOptions &options, Tile &tile) {
+  const auto &items = decoder.items;
+  auto &diagnostics = decoder.diagnostics;
+  auto tile_end = tile_node.props_end;
 
-        case ATTR_ATTACK:
-          item.attack = read<int32_t>(item_begin, item_end);
-          break;
+  if (options.presize) {
+    tile.reserve(count_tile_items(tile_node, tile_begin, tile_end, items));
+  }
+  // A second ground replaces the first, along with its entry in the script index.
+  auto first_entry = static_cast<std::ptrdiff_t>(decoder.indexed.size());
+  auto emplace = [&](otb::Item &&item) {
+    if (item.type->is_ground_tile() and tile.ground()) {
+      auto &indexed = decoder.indexed;
+      indexed.erase(std::remove_if(indexed.begin() + first_entry, indexed.end(), [](const auto &entry) { return not entry.item and entry.slot < 0; }),
+                    indexed.end());
+    }
+    auto capacity = tile.items().capacity();
+    tile.emplace_item(std::move(item));
+    decoder.reallocations += tile.items().capacity() != capacity;
+  };
+
+  while (tile_begin != tile_end) {
+    auto attr_at = tile_begin;
+    auto attr = uint8_t{0};
+    if (not try_read(tile_begin, tile_end, attr)) {
+      return {otb::DecodeError::TRUNCATED, tile_begin};
+    }
+    switch (attr) {
+    case ATTR_TILE_FLAGS: {
+      auto flags = uint32_t{0};
+      if (not try_read(tile_begin, tile_end, flags)) {
+        return {otb::DecodeError::TRUNCATED, tile_begin, attr};
+      }
 
-        case ATTR_DEFENSE:
-          item.defense = read<int32_t>(item_begin, item_end);
-          break;
+      if (flags & TILEFLAG_PROTECTIONZONE) {
+        tile.add_flags(TILESTATE_PROTECTIONZONE);
+      } else if (flags & TILEFLAG_NOPVPZONE) {
+        tile.add_flags(TILESTATE_NOPVPZONE);
+      } else if (flags & TILEFLAG_PVPZONE) {
+        tile.add_flags(TILESTATE_PVPZONE);
+      }
 
-        case ATTR_EXTRADEFENSE:
-          item.extra_defense = read<int32_t>(item_begin, item_end);
-          break;
+      if (flags & TILEFLAG_NOLOGOUT) {
+        tile.add_flags(TILESTATE_NOLOGOUT);
+      }
 
-        case ATTR_ARMOR:
-          item.armor = read<int32_t>(item_begin, item_end);
-          break;
+      break;
+    }
 
-        case ATTR_HITCHANCE:
-          item.hit_chance = read<uint8_t>(item_begin, item_end);
-          break;
+    case ATTR_ITEM: {
+      auto id = uint16_t{0};
+      if (not try_read(tile_begin, tile_end, id)) {
+        return {otb::DecodeError::TRUNCATED, tile_begin, attr};
+      }
+      id = get_persistent_id(id);
+      auto type = items.find(id);
+      if (not type) {
+        return {otb::DecodeError::UNKNOWN_ITEM_ID, attr_at, attr, id};
+      }
 
-        case ATTR_SHOOTRANGE:
-          item.shoot_range = read<uint8_t>(item_begin, item_end);
-          break;
+      if (house_id != 0 and type->moveable()) {
+        diagnostics.report({otb::Warning::MOVEABLE_HOUSE_ITEM, 0, id, house_id, coords});
+        break;
+      }
 
-        case ATTR_DECAYTO:
-          item.decay_to = read<int32_t>(item_begin, item_end);
-          break;
+      emplace(otb::Item{type});
+      break;
+    }
 
-        case ATTR_WRAPID:
-          item.wrap_id = read<uint16_t>(item_begin, item_end);
-          break;
+    default:
+      return {otb::DecodeError::UNKNOWN_ATTRIBUTE, attr_at, attr};
+    }
+  }
 
-        case ATTR_STOREITEM:
-          item.store_item = read<uint8_t>(item_begin, item_end);
-          break;
+  for (const auto &item_node : tile_node.children) {
+    std::optional<otb::Item> item;
+    auto status = decoder.decode(item_node, coords, item);
+    if (status.ok() and not (house_id != 0 and item->type->moveable())) {
+      status = decoder.decode_contents(*item, item_node, coords);
+    }
+    if (not status.ok()) {
+      return status;
+    }
 
-          // these should be handled through derived classes
-          // if these are called then something has changed in the items.xml since the map was saved
-          // just read the values
+    if (house_id != 0 and item->type->moveable()) {
+      diagnostics.report({otb::Warning::MOVEABLE_HOUSE_ITEM, 0, item->type->id(), house_id, coords});
+      continue;
+    }
+    auto slot = item->type->is_ground_tile() ? -1 : static_cast<int32_t>(tile.items().size());
+    auto indexed = has_script_id(*item);
+    emplace(std::move(*item));
+    if (indexed) {
+      decoder.indexed.push_back({coords, slot, nullptr, decoder.tiles});
+    }
+  }
+  return {};
+}
 
-        case ATTR_DEPOT_ID:
-          skip(item_begin, item_end, 2);
-          break;
+// Skips what failed to decode in a lenient load, or throws.
+void fail(Status status, otb::Warning skipped, const Coords &coords, const ItemDecoder &decoder, const LoadOptions &options) {
+  auto offset = static_cast<uint64_t>(status.at - decoder.data);
+  if (not options.lenient) {
+    throw std::invalid_argument(fmt::format("Could not decode {:s} @ {}: {:s} (attribute {:d}, ID {:d}) at offset {:d}",
+                                            skipped == otb::Warning::SKIPPED_TILE ? "tile" : "tile area", coords, otb::describe(status.error),
+                                            status.attribute, status.item_id, offset));
+  }
+  decoder.diagnostics.report({skipped, status.attribute, status.item_id, static_cast<uint32_t>(status.error), coords, offset});
+}
 
-        case ATTR_HOUSEDOORID:
-          skip(item_begin, item_end, 1);
-          break;
+// Reads the position of a tile area. Returns false for areas that `options` leaves out, or that a lenient load skips.
+bool read_area(const otb::node &node, const ItemDecoder &decoder, const LoadOptions &options, Coords &area_coords) {
+  auto node_begin = node.props_begin;
+  if (not try_read_coords(node_begin, node.props_end, area_coords)) {
+    fail({otb::DecodeError::TRUNCATED, node_begin}, otb::Warning::SKIPPED_TILE_AREA, area_coords, decoder, options);
+    return false;
+  }
+  return options.overlaps_area(area_coords);
+}
 
-        case ATTR_SLEEPERGUID:
-        case ATTR_SLEEPSTART:
-          skip(item_begin, item_end, 4);
-          break;
+// Decodes a tile node of the area based at `area_coords` into `coords` and `tile`. Returns false for tiles that `options` leaves out, or
+// that a lenient load skips.
+bool parse_tile(const otb::node &tile_node, const Coords &area_coords, ItemDecoder &decoder, HouseTiles &house_tiles, const LoadOptions &options,
+                Coords &coords, Tile &tile) {
+  auto tile_begin = tile_node.props_begin;
+  auto tile_end = tile_node.props_end;
+  if (tile_node.type != NODETYPE_TILE and tile_node.type != NODETYPE_HOUSETILE) {
+    fail({otb::DecodeError::UNKNOWN_NODE_TYPE, tile_begin - 1, static_cast<uint8_t>(tile_node.type)}, otb::Warning::SKIPPED_TILE, area_coords,
+         decoder, options);
+    return false;
+  }
 
-        case ATTR_TELE_DEST:
-          skip(item_begin, item_end, 5);
-          break;
+  auto dx = uint8_t{0}, dy = uint8_t{0};
+  if (not try_read(tile_begin, tile_end, dx) or not try_read(tile_begin, tile_end, dy)) {
+    fail({otb::DecodeError::TRUNCATED, tile_begin}, otb::Warning::SKIPPED_TILE, area_coords, decoder, options);
+    return false;
+  }
+  coords = Coords{static_cast<uint16_t>(area_coords.x + dx), static_cast<uint16_t>(area_coords.y + dy), area_coords.z};
+  if (not options.contains(coords)) {
+    return false;
+  }
 
-        case ATTR_CONTAINER_ITEMS:
-          throw std::invalid_argument("Invalid attribute: container items");
+  uint32_t house_id = 0;
+  if (tile_node.type == NODETYPE_HOUSETILE and not try_read(tile_begin, tile_end, house_id)) {
+    fail({otb::DecodeError::TRUNCATED, tile_begin}, otb::Warning::SKIPPED_TILE, coords, decoder, options);
+    return false;
+  }
 
-        case ATTR_CUSTOM_ATTRIBUTES: {
-          uint64_t len = read<uint64_t>(item_begin, item_end);
+  auto pool_size = decoder.pool.size();
+  auto indexed_size = decoder.indexed.size();
+  if (auto status = decode_tile(tile_node, tile_begin, coords, house_id, decoder, options, tile); not status.ok()) {
+    decoder.rollback(pool_size, indexed_size);
+    fail(status, otb::Warning::SKIPPED_TILE, coords, decoder, options);
+    return false;
+  }
+  ++decoder.tiles;
 
-          for (uint64_t i = 0; i < len; ++i) {
-            auto key_len = read<uint16_t>(item_begin, item_end);
-            auto key = read_string(item_begin, item_end, key_len);
+  if (house_id != 0) {
+    house_tiles[house_id].push_back(coords);
+  }
+  if (decoder.types) {
+    if (tile.ground()) {
+      decoder.types->add(tile.ground()->type->id(), coords);
+    }
+    for (const auto &item : tile.items()) {
+      decoder.types->add(item.type->id(), coords);
+    }
+    for (auto id : decoder.tile_types) {
+      decoder.types->add(id, coords);
+    }
+    decoder.tile_types.clear();
+  }
+  return true;
+}
 
-            auto val = otb::Item::attribute{};
+template <class T>
+void parse_tile_area(const otb::node &node, ItemDecoder &decoder, HouseTiles &house_tiles, const LoadOptions &options, T &&callback) {
+  auto area_coords = Coords{};
+  if (not read_area(node, decoder, options, area_coords)) {
+    return;
+  }
 
-            switch (read<uint8_t>(item_begin, item_end)) {
-            case 1: {
-              auto val_len = read<uint16_t>(item_begin, item_end);
-              val = read_string(item_begin, item_end, val_len);
-              break;
-            }
+  for (const auto &tile_node : node.children) {
+    auto coords = Coords{};
+    auto tile = Tile{};
+    if (parse_tile(tile_node, area_coords, decoder, house_tiles, options, coords, tile)) {
+      callback(std::move(coords), std::move(tile));
+    }
+  }
+}
 
-            case 2:
-              val = read<int64_t>(item_begin, item_end);
-              break;
+struct AreaCounts {
+  size_t tiles = 0;
+  // Items inside containers, which go to the item pool.
+  size_t contents = 0;
+};
 
-            case 3:
-              val = read<double>(item_begin, item_end);
-              break;
+// Counts the tiles of an area that `options` keeps and the items inside their containers, reading nothing but tile positions. Broken
+// positions are left to the decoder to report. `pending` is scratch space for walking nested containers.
+AreaCounts count_area(const otb::node &node, const LoadOptions &options, std::vector<const otb::node *> &pending) {
+  AreaCounts counts;
+  auto node_begin = node.props_begin;
+  auto area_coords = Coords{};
+  if (not try_read_coords(node_begin, node.props_end, area_coords) or not options.overlaps_area(area_coords)) {
+    return counts;
+  }
 
-            case 4:
-              val = read<bool>(item_begin, item_end);
-              break;
-            }
+  for (const auto &tile_node : node.children) {
+    auto tile_begin = tile_node.props_begin;
+    auto tile_end = tile_node.props_end;
+    auto dx = uint8_t{0}, dy = uint8_t{0};
+    if (not try_read(tile_begin, tile_end, dx) or not try_read(tile_begin, tile_end, dy) or
+        not options.contains({static_cast<uint16_t>(area_coords.x + dx), static_cast<uint16_t>(area_coords.y + dy), area_coords.z})) {
+      continue;
+    }
 
-            item.custom_attributes.emplace(key, val);
+    counts.tiles += 1;
+    for (const auto &item_node : tile_node.children) {
+      pending.push_back(&item_node);
+      while (not pending.empty()) {
+        auto item = pending.back();
+        pending.pop_back();
+        counts.contents += item->children.size();
+        for (const auto &child : item->children) {
+          if (not child.children.empty()) {
+            pending.push_back(&child);
           }
-          break;
-        }
-
-        default:
-          std::vector<unsigned> bytes(item_node.props_begin, item_node.props_end);
-          fmt::print("[Warning] Unknown item attribute: {:d} ({:s} @ {}, bytes: {})\n", attr, type.name(), Coords{x, y, z}, fmt::join(bytes, " "));
-          break;
         }
       }
     }
+  }
+  return counts;
+}
 
-    callback({x, y, z}, std::move(*tile));
+// Resolves the indexed items of a finished tile table, in the order they were decoded.
+// `dropped` holds the numbers of the tiles left out of `tiles` for having the position of one already there, in ascending order.
+void index_scripts(const std::vector<IndexedItem> &indexed, const std::vector<uint32_t> &dropped, const Tiles &tiles, ScriptIndex &index,
+                   otb::DiagnosticSink &diagnostics) {
+  auto next_dropped = dropped.begin();
+  for (const auto &[coords, slot, item, tile_number] : indexed) {
+    while (next_dropped != dropped.end() and *next_dropped < tile_number) {
+      ++next_dropped;
+    }
+    if (next_dropped != dropped.end() and *next_dropped == tile_number) {
+      continue;
+    }
+    if (item) {
+      index.add({coords, item}, diagnostics);
+      continue;
+    }
+    // Not kept when the map is only streamed through a tile visitor.
+    auto it = tiles.find(coords);
+    if (it == tiles.end()) {
+      continue;
+    }
+    const auto &tile = it->second;
+    if (slot < 0 and tile.ground()) {
+      index.add({coords, &*tile.ground()}, diagnostics);
+    } else if (slot >= 0 and static_cast<size_t>(slot) < tile.items().size()) {
+      index.add({coords, &tile.items()[static_cast<size_t>(slot)]}, diagnostics);
+    }
   }
 }
 
@@ -538,12 +627,13 @@ template <class T> void parse_waypoints(const otb::node &node, T &&callback) {
   }
 }
 
-} // namespace
-
-Map load(std::string_view filename, const otbi::Items &items) {
-  auto loader = otb::load(filename, "OTBM");
-  auto first = loader.begin(), last = loader.end();
+struct MapData {
+  const otb::node &node;
+  uint32_t version;
+};
 
+// Checks the properties of the root node of a map and returns its version.
+uint32_t read_map_header(otb::iterator first, const otb::iterator &last) {
   auto version = read<uint32_t>(first, last);
 
   if (version == 0) {
@@ -558,28 +648,33 @@ Map load(std::string_view filename, const otbi::Items &items) {
   auto width = read<uint16_t>(first, last);
   auto height = read<uint16_t>(first, last);
   fmt::print("> Map size: {:d}x{:d}.\n", width, height);
+  return version;
+}
+
+// Checks the header of a map and returns its map data node.
+MapData read_map_data(const otb::OTB &loader) {
+  auto version = read_map_header(loader.begin(), loader.end());
 
   if (loader.children().size() != 1 or loader.children().front().type != NODETYPE_MAP_DATA) {
     throw std::invalid_argument("Could not read data node.");
   }
 
-  auto map_node = loader.children().front();
-  auto attributes = parse_map_attributes(map_node);
-  fmt::print(">> Description: '{:s}'\n>> Houses: '{:s}'\n>> Spawns: '{:s}'\n", attributes.description, attributes.houses, attributes.spawns);
-
-  Tiles tiles;
-  Towns towns;
-  Waypoints waypoints;
+  return {loader.children().front(), version};
+}
 
-  for (auto &node : map_node.children) {
+// Parses the towns and waypoints of the map data node and hands every tile area to `on_area`.
+template <class T> void parse_map_data(const MapData &map, Towns &towns, Waypoints &waypoints, T &&on_area) {
+  for (auto &node : map.node.children) {
     if (node.type == NODETYPE_TILE_AREA) {
-      parse_tile_area(node, items, [&](Coords &&coords, Tile &&tile) { tiles.emplace(coords, std::move(tile)); });
+      on_area(node);
     } else if (node.type == NODETYPE_TOWNS) {
+      towns.reserve(towns.size() + node.children.size());
       parse_towns(node, [&](uint32_t id, Town &&town) {
         fmt::print(">>> Town {:d} ({:s} @ {})\n", id, town.name, town.temple);
         towns.insert_or_assign(id, std::move(town));
       });
-    } else if (node.type == NODETYPE_WAYPOINTS and version > 1) {
+    } else if (node.type == NODETYPE_WAYPOINTS and map.version > 1) {
+      waypoints.reserve(waypoints.size() + node.children.size());
       parse_waypoints(node, [&](std::string &&name, Coords &&coords) {
         fmt::print(">>> Waypoint {:s}: {}.\n", name, coords);
         waypoints.insert_or_assign(std::move(name), coords);
@@ -588,9 +683,612 @@ Map load(std::string_view filename, const otbi::Items &items) {
       throw std::invalid_argument(fmt::format("Unknown map node: {:d}", node.type));
     }
   }
+}
+
+// What a load keeps of the tile areas of the map data node.
+struct MapCounts {
+  size_t tiles = 0;
+  size_t contents = 0;
+  // The most tiles and container items found in a single area, for buffers that only hold one area at a time.
+  size_t area_tiles = 0;
+  size_t area_contents = 0;
+};
+
+MapCounts count_map_data(const MapData &map, const LoadOptions &options) {
+  MapCounts counts;
+  std::vector<const otb::node *> pending;
+  for (const auto &node : map.node.children) {
+    if (node.type == NODETYPE_TILE_AREA) {
+      auto area = count_area(node, options, pending);
+      counts.tiles += area.tiles;
+      counts.contents += area.contents;
+      counts.area_tiles = std::max(counts.area_tiles, area.tiles);
+      counts.area_contents = std::max(counts.area_contents, area.contents);
+    }
+  }
+  return counts;
+}
+
+// The spawn and house files named by a map. They are independent of the tiles, so they are parsed on their own threads meanwhile and only
+// joined at the end.
+class ExternalFiles {
+public:
+  template <class Attributes> ExternalFiles(std::string_view filename, const Attributes &attributes, const LoadOptions &options) {
+    auto directory = std::string{filename.substr(0, filename.rfind('/') + 1)};
+    if (options.external_files and not attributes.houses.empty()) {
+      houses = std::async(std::launch::async, load_houses, directory + attributes.houses);
+    }
+    if (options.external_files and not attributes.spawns.empty()) {
+      spawns = std::async(std::launch::async, load_spawns, directory + attributes.spawns);
+    }
+  }
+
+  // Waits for the files and fills the houses with their tiles. Without a house file the tile index is still kept, under houses that only have
+  // an id.
+  std::pair<Houses, Spawns> join(const HouseTiles &house_tiles, otb::DiagnosticSink &diagnostics, otb::LoadStats *stats) {
+    auto external_timer = otb::PhaseTimer{stats ? &stats->external : nullptr};
+    auto house_file = get(this->houses, 0, diagnostics);
+    auto spawn_file = get(this->spawns, 1, diagnostics);
+    external_timer.stop();
+
+    auto have_house_file = house_file.has_value();
+    auto houses = have_house_file ? std::move(*house_file) : Houses{};
+    auto spawns = spawn_file ? std::move(*spawn_file) : Spawns{};
+    for (const auto &[id, coords] : house_tiles) {
+      if (have_house_file and houses.count(id) == 0) {
+        diagnostics.report({otb::Warning::UNKNOWN_HOUSE, 0, 0, id, coords.front()});
+        continue;
+      }
+      auto &house = houses[id];
+      house.id = id;
+      house.tiles = coords;
+    }
+    if (stats) {
+      stats->houses += houses.size();
+      stats->spawns += spawns.size();
+    }
+    return {std::move(houses), std::move(spawns)};
+  }
+
+private:
+  // Waits for a file and returns what it holds, or nothing when it is missing or broken. Maps loaded without their files before these were
+  // read, so that is reported rather than thrown; the diagnostic says which of the two files it was.
+  template <class T> static std::optional<T> get(std::future<T> &file, uint32_t kind, otb::DiagnosticSink &diagnostics) {
+    if (not file.valid()) {
+      return {};
+    }
+    try {
+      return file.get();
+    } catch (const std::exception &) {
+      diagnostics.report({otb::Warning::MISSING_EXTERNAL_FILE, 0, 0, kind});
+      return {};
+    }
+  }
+
+  std::future<Houses> houses = {};
+  std::future<Spawns> spawns = {};
+};
+
+// Maps a map file whatever the strategy asked for, as a buffer read whole would hold all of it in memory.
+otb::File map_file(std::string_view filename, const LoadOptions &options) {
+  auto io = options.io;
+  io.strategy = otb::IoStrategy::MMAP;
+  auto timer = otb::PhaseTimer{options.stats ? &options.stats->map_file : nullptr};
+  return otb::File{std::string{filename}, io};
+}
+
+} // namespace
+
+Map load(std::string_view filename, const otbi::Items &items, const LoadOptions &options) {
+  auto stats = options.stats;
+  auto memory = otb::MemoryScope{stats};
+  auto loader = otb::load(filename, "OTBM", options);
+
+  auto fallback_diagnostics = otb::Diagnostics{};
+  auto &diagnostics = options.diagnostics ? *options.diagnostics : fallback_diagnostics;
+
+  auto map_data = read_map_data(loader);
+  auto attributes = parse_map_attributes(map_data.node);
+  fmt::print(">> Description: '{:s}'\n>> Houses: '{:s}'\n>> Spawns: '{:s}'\n", attributes.description, attributes.houses, attributes.spawns);
+  auto external = ExternalFiles{filename, attributes, options};
+
+  Tiles tiles;
+  Towns towns;
+  Waypoints waypoints;
+
+  HouseTiles house_tiles;
+
+  otb::ItemPool contents;
+  auto types = TypeIndex::Builder{};
+  auto decoder = ItemDecoder{items, diagnostics, contents, loader.data()};
+  if (options.index_types) {
+    decoder.types = &types;
+  }
+
+  // Tiles are decoded an area at a time so decoding and insertion can be timed apart.
+  std::vector<std::pair<Coords, Tile>> area_tiles;
+  auto counts = MapCounts{};
+  if (options.presize) {
+    auto count_timer = otb::PhaseTimer{stats ? &stats->count : nullptr};
+    counts = count_map_data(map_data, options);
+    if (options.keep_tiles) {
+      tiles.reserve(counts.tiles);
+    }
+    area_tiles.reserve(counts.area_tiles);
+  }
+  // Without the tiles, container items only live as long as their area.
+  auto reserve_contents = [&] {
+    auto count = options.keep_tiles ? counts.contents : counts.area_contents;
+    if (count > 0) {
+      contents.reserve(count);
+    }
+  };
+  reserve_contents();
+
+  size_t decoded = 0;
+  uint64_t rehashes = 0;
+  // Tiles are numbered as the decoder does, so the script index can leave out those at a position already taken.
+  uint32_t tile_number = 0;
+  std::vector<uint32_t> dropped;
+  parse_map_data(map_data, towns, waypoints, [&](const otb::node &node) {
+    area_tiles.clear();
+    auto decode_timer = otb::PhaseTimer{stats ? &stats->decode : nullptr};
+    parse_tile_area(node, decoder, house_tiles, options, [&](Coords &&coords, Tile &&tile) { area_tiles.emplace_back(coords, std::move(tile)); });
+    decode_timer.stop();
+
+    auto insertion_timer = otb::PhaseTimer{stats ? &stats->insertion : nullptr};
+    for (auto &[coords, tile] : area_tiles) {
+      if (stats) {
+        stats->items += tile.items().size() + (tile.ground() ? 1 : 0);
+      }
+      if (options.tile_visitor) {
+        options.tile_visitor(coords, tile);
+      }
+      if (options.keep_tiles) {
+        auto buckets = tiles.bucket_count();
+        if (not tiles.emplace(coords, std::move(tile)).second) {
+          dropped.push_back(tile_number);
+        }
+        rehashes += tiles.bucket_count() != buckets;
+      }
+      ++tile_number;
+    }
+    insertion_timer.stop();
+
+    decoded += area_tiles.size();
+    if (not options.keep_tiles) {
+      if (stats) {
+        stats->items += contents.size();
+      }
+      contents.clear();
+      decoder.indexed.clear();
+      reserve_contents();
+    }
+  });
+  loader.release();
+
+  ScriptIndex scripts;
+  index_scripts(decoder.indexed, dropped, tiles, scripts, diagnostics);
+  auto type_index = options.index_types ? TypeIndex{std::move(types)} : TypeIndex{};
+
+  auto [houses, spawns] = external.join(house_tiles, diagnostics, stats);
+
+  if (stats) {
+    stats->tiles += decoded;
+    stats->items += contents.size();
+    stats->rehashes += rehashes;
+    stats->reallocations += decoder.reallocations;
+  }
+
+  if (not options.diagnostics) {
+    fallback_diagnostics.print_summary();
+  }
+
+  fmt::print("Loaded {:d} map tiles.\n", decoded);
+  return {std::move(tiles), std::move(towns), std::move(waypoints), std::move(houses), std::move(spawns), std::move(contents), std::move(scripts),
+          std::move(type_index)};
+}
+
+void check_tile_area(const otb::node &node, otb::iterator data, const otbi::Items &items, otb::DiagnosticSink &diagnostics,
+                     const std::function<void(const otb::node &, const Coords &)> &visit) {
+  auto options = LoadOptions{};
+  options.lenient = true;
+  options.presize = false;
+
+  otb::ItemPool contents;
+  HouseTiles house_tiles;
+  auto decoder = ItemDecoder{items, diagnostics, contents, data};
+  auto area_coords = Coords{};
+  if (not read_area(node, decoder, options, area_coords)) {
+    return;
+  }
+  for (const auto &tile_node : node.children) {
+    auto coords = Coords{};
+    auto tile = Tile{};
+    if (parse_tile(tile_node, area_coords, decoder, house_tiles, options, coords, tile) and visit) {
+      visit(tile_node, coords);
+    }
+  }
+}
+
+void ShardLayout::validate() const {
+  if (stripes == 0) {
+    throw std::invalid_argument("A shard layout needs at least one stripe.");
+  }
+  if (stripe_width % 256 != 0) {
+    throw std::invalid_argument(fmt::format("Stripe width {:d} is not a multiple of the tile area size.", stripe_width));
+  }
+  if (stripe_width == 0 and stripes != 1) {
+    throw std::invalid_argument("Stripes need a width.");
+  }
+  for (size_t i = 0; i < floor_splits.size(); ++i) {
+    if (floor_splits[i] == 0 or floor_splits[i] >= MAP_MAX_LAYERS or (i > 0 and floor_splits[i] <= floor_splits[i - 1])) {
+      throw std::invalid_argument(fmt::format("Invalid floor split {:d}.", floor_splits[i]));
+    }
+  }
+}
+
+ShardedMap load_sharded(std::string_view filename, const otbi::Items &items, const ShardLayout &layout, const LoadOptions &options) {
+  layout.validate();
+
+  auto stats = options.stats;
+  auto memory = otb::MemoryScope{stats};
+  auto loader = otb::load(filename, "OTBM", options);
+
+  auto fallback_diagnostics = otb::Diagnostics{};
+  auto &diagnostics = options.diagnostics ? *options.diagnostics : fallback_diagnostics;
+
+  auto map_data = read_map_data(loader);
+  auto attributes = parse_map_attributes(map_data.node);
+  fmt::print(">> Description: '{:s}'\n>> Houses: '{:s}'\n>> Spawns: '{:s}'\n", attributes.description, attributes.houses, attributes.spawns);
+  auto external = ExternalFiles{filename, attributes, options};
+
+  Towns towns;
+  Waypoints waypoints;
+
+  // Each shard decodes only the tiles of its own stripe, so that a tile is in the shard ShardedMap::find() looks in even when its area crosses
+  // into the next stripe. Editors start areas at multiples of 256, which stripes never split, but nothing in the format requires it.
+  auto count = layout.count();
+  std::vector<LoadOptions> shard_options(count, options);
+  if (layout.stripe_width) {
+    for (size_t i = 0; i < count; ++i) {
+      auto stripe = i % layout.stripes;
+      if (stripe * layout.stripe_width > 0xFFFF) {
+        // A stripe past the edge of the map.
+        shard_options[i].floors.reset();
+        continue;
+      }
+      auto x0 = static_cast<uint16_t>(stripe * layout.stripe_width);
+      auto x1 = static_cast<uint16_t>(stripe + 1 == layout.stripes ? 0xFFFF : std::min<size_t>((stripe + 1) * layout.stripe_width - 1, 0xFFFF));
+      auto &regions = shard_options[i].regions;
+      if (regions.empty()) {
+        regions.push_back({x0, 0, x1, 0xFFFF});
+        continue;
+      }
+      std::vector<Rect> clipped;
+      for (const auto &rect : regions) {
+        if (rect.x1 >= x0 and rect.x0 <= x1) {
+          clipped.push_back({std::max(rect.x0, x0), rect.y0, std::min(rect.x1, x1), rect.y1});
+        }
+      }
+      regions = std::move(clipped);
+      if (regions.empty()) {
+        // None of the requested regions reach this stripe.
+        shard_options[i].floors.reset();
+      }
+    }
+  }
+
+  std::vector<std::vector<const otb::node *>> areas(count);
+  parse_map_data(map_data, towns, waypoints, [&](const otb::node &node) {
+    // An area with a broken position is left to the first shard's decoder to report.
+    auto first = node.props_begin;
+    auto base = Coords{};
+    if (not try_read_coords(first, node.props_end, base)) {
+      areas[0].push_back(&node);
+      return;
+    }
+    auto last = layout.shard({static_cast<uint16_t>(std::min(base.x + 0xFF, 0xFFFF)), base.y, base.z});
+    for (auto i = layout.shard(base); i <= last; ++i) {
+      if (shard_options[i].overlaps_area(base)) {
+        areas[i].push_back(&node);
+      }
+    }
+  });
+
+  // Each shard is built by a thread of its own, so its tables and items come from that thread's allocator arena and, when pinned, from pages
+  // of its NUMA node.
+  auto numa_nodes = layout.numa ? otb::numa_nodes() : std::vector<std::vector<unsigned>>{};
+  std::vector<std::unique_ptr<Shard>> shards(count);
+  std::vector<HouseTiles> house_tiles(count);
+  std::vector<std::vector<IndexedItem>> indexed(count);
+  std::vector<std::vector<uint32_t>> dropped(count);
+  std::vector<TypeIndex::Builder> types(count);
+  std::vector<uint64_t> rehashes(count);
+  std::vector<uint64_t> reallocations(count);
+  std::vector<std::exception_ptr> errors(count);
+
+  auto decode_timer = otb::PhaseTimer{stats ? &stats->decode : nullptr};
+  std::vector<std::thread> threads;
+  threads.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    threads.emplace_back([&, i] {
+      try {
+        auto numa_node = -1;
+        if (not numa_nodes.empty() and otb::pin_thread(numa_nodes[i % numa_nodes.size()])) {
+          numa_node = static_cast<int>(i % numa_nodes.size());
+        }
+
+        auto shard = std::make_unique<Shard>();
+        shard->numa_node = numa_node;
+        if (options.presize) {
+          auto counts = AreaCounts{};
+          std::vector<const otb::node *> pending;
+          for (auto area : areas[i]) {
+            auto area_counts = count_area(*area, shard_options[i], pending);
+            counts.tiles += area_counts.tiles;
+            counts.contents += area_counts.contents;
+          }
+          shard->tiles.reserve(counts.tiles);
+          if (counts.contents > 0) {
+            shard->contents.reserve(counts.contents);
+          }
+        }
+
+        auto decoder = ItemDecoder{items, diagnostics, shard->contents, loader.data()};
+        if (options.index_types) {
+          decoder.types = &types[i];
+        }
+        uint32_t tile_number = 0;
+        for (auto area : areas[i]) {
+          parse_tile_area(*area, decoder, house_tiles[i], shard_options[i], [&](Coords &&coords, Tile &&tile) {
+            auto buckets = shard->tiles.bucket_count();
+            if (not shard->tiles.emplace(coords, std::move(tile)).second) {
+              dropped[i].push_back(tile_number);
+            }
+            rehashes[i] += shard->tiles.bucket_count() != buckets;
+            ++tile_number;
+          });
+        }
+        reallocations[i] = decoder.reallocations;
+        indexed[i] = std::move(decoder.indexed);
+        shards[i] = std::move(shard);
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  decode_timer.stop();
+  for (auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  loader.release();
+
+  // Shards are indexed in order, so the first of duplicate unique ids is the same whatever thread finished first.
+  ScriptIndex scripts;
+  for (size_t i = 0; i < count; ++i) {
+    index_scripts(indexed[i], dropped[i], shards[i]->tiles, scripts, diagnostics);
+  }
+  for (size_t i = 1; i < count; ++i) {
+    types.front().merge(std::move(types[i]));
+  }
+  auto type_index = options.index_types ? TypeIndex{std::move(types.front())} : TypeIndex{};
+
+  HouseTiles all_house_tiles;
+  for (const auto &shard_house_tiles : house_tiles) {
+    for (const auto &[id, coords] : shard_house_tiles) {
+      auto &tiles = all_house_tiles[id];
+      tiles.insert(tiles.end(), coords.begin(), coords.end());
+    }
+  }
+  auto [houses, spawns] = external.join(all_house_tiles, diagnostics, stats);
+
+  size_t tile_count = 0;
+  for (const auto &shard : shards) {
+    tile_count += shard->tiles.size();
+    if (stats) {
+      stats->items += shard->contents.size();
+      for (const auto &[coords, tile] : shard->tiles) {
+        stats->items += tile.items().size() + (tile.ground() ? 1 : 0);
+      }
+    }
+  }
+  if (stats) {
+    stats->tiles += tile_count;
+    stats->rehashes += std::accumulate(rehashes.begin(), rehashes.end(), uint64_t{0});
+    stats->reallocations += std::accumulate(reallocations.begin(), reallocations.end(), uint64_t{0});
+  }
+
+  if (not options.diagnostics) {
+    fallback_diagnostics.print_summary();
+  }
+
+  fmt::print("Loaded {:d} map tiles into {:d} shards.\n", tile_count, count);
+  return {layout, std::move(shards), std::move(towns), std::move(waypoints), std::move(houses), std::move(spawns), std::move(scripts),
+          std::move(type_index)};
+}
+
+struct TileReader::State {
+  State(std::string_view filename, const otbi::Items &items, const LoadOptions &options);
+
+  State(const State &) = delete;
+  State &operator=(const State &) = delete;
+
+  // Decodes the next tile area holding any tile that the options keep, stepping over towns and waypoints. Returns false at the end of the map.
+  bool read_area();
+
+  LoadOptions options;
+  otb::File file;
+  otb::Diagnostics fallback_diagnostics;
+  otb::ItemPool contents = {};
+  ItemDecoder decoder;
+  // Filled by the tile decoder, but not kept.
+  HouseTiles house_tiles = {};
+  std::vector<const otb::node *> pending = {};
+  // Tiles of the current area, and the one the reader is at.
+  std::vector<std::pair<Coords, Tile>> tiles = {};
+  size_t position = 0;
+  // Next node of the map data node.
+  otb::iterator cursor = nullptr;
+  otb::iterator last = nullptr;
+  uint32_t version = 0;
+  size_t read = 0;
+  bool started = false;
+  bool done = false;
+};
+
+TileReader::State::State(std::string_view filename, const otbi::Items &items, const LoadOptions &options)
+    : options{options}, file{map_file(filename, options)}, fallback_diagnostics{},
+      decoder{items, options.diagnostics ? *options.diagnostics : fallback_diagnostics, contents, file.data()} {
+  auto first = otb::check_header(file, "OTBM");
+  last = file.end();
+  if (last - first < 2 or *first != otb::detail::START) {
+    throw std::invalid_argument("Invalid first byte.");
+  }
+
+  auto props_end = otb::find_props_end(first + 2, last);
+  version = read_map_header(first + 2, props_end);
+  if (last - props_end < 2 or *props_end != otb::detail::START or props_end[1] != NODETYPE_MAP_DATA) {
+    throw std::invalid_argument("Could not read data node.");
+  }
+  cursor = otb::find_props_end(props_end + 2, last);
+}
+
+bool TileReader::State::read_area() {
+  if (done) {
+    return false;
+  }
+
+  auto stats = options.stats;
+  while (true) {
+    tiles.clear();
+    position = 0;
+    contents.clear();
+    decoder.indexed.clear();
+    house_tiles.clear();
+    // Nothing before the next node is read again.
+    file.discard(static_cast<size_t>(cursor - file.begin()));
+
+    if (cursor == last) {
+      throw std::invalid_argument("File overflow in map data.");
+    }
+    if (*cursor == otb::detail::END) {
+      break;
+    }
+
+    auto scan_timer = otb::PhaseTimer{stats ? &stats->tree_scan : nullptr};
+    auto node = otb::parse_node(cursor, last);
+    scan_timer.stop();
+    if (node.type == NODETYPE_TOWNS or (node.type == NODETYPE_WAYPOINTS and version > 1)) {
+      continue;
+    }
+    if (node.type != NODETYPE_TILE_AREA) {
+      throw std::invalid_argument(fmt::format("Unknown map node: {:d}", node.type));
+    }
+
+    if (options.presize) {
+      auto count_timer = otb::PhaseTimer{stats ? &stats->count : nullptr};
+      auto counts = count_area(node, options, pending);
+      tiles.reserve(counts.tiles);
+      if (counts.contents > 0) {
+        contents.reserve(counts.contents);
+      }
+    }
+
+    auto decode_timer = otb::PhaseTimer{stats ? &stats->decode : nullptr};
+    parse_tile_area(node, decoder, house_tiles, options, [&](Coords &&coords, Tile &&tile) { tiles.emplace_back(coords, std::move(tile)); });
+    decode_timer.stop();
+
+    read += tiles.size();
+    if (stats) {
+      stats->tiles += tiles.size();
+      stats->items += contents.size();
+      for (const auto &[coords, tile] : tiles) {
+        stats->items += tile.items().size() + (tile.ground() ? 1 : 0);
+      }
+    }
+    if (not tiles.empty()) {
+      return true;
+    }
+  }
 
-  fmt::print("Loaded {:d} map tiles.\n", tiles.size());
-  return {std::move(tiles), std::move(towns), std::move(waypoints)};
+  done = true;
+  if (stats) {
+    stats->reallocations += decoder.reallocations;
+  }
+  if (not options.diagnostics) {
+    fallback_diagnostics.print_summary();
+  }
+  fmt::print("Read {:d} map tiles.\n", read);
+  return false;
+}
+
+TileReader::TileReader(std::string_view filename, const otbi::Items &items, const LoadOptions &options)
+    : state{std::make_unique<State>(filename, items, options)} {}
+
+TileReader::~TileReader() = default;
+
+TileReader::TileReader(TileReader &&) noexcept = default;
+TileReader &TileReader::operator=(TileReader &&) noexcept = default;
+
+bool TileReader::next() {
+  state->started = true;
+  if (state->position + 1 < state->tiles.size()) {
+    ++state->position;
+    return true;
+  }
+  return state->read_area();
+}
+
+std::pair<Coords, Tile> &TileReader::current() { return state->tiles[state->position]; }
+
+TileReader::iterator TileReader::begin() {
+  if (not state->started) {
+    next();
+  }
+  return state->tiles.empty() ? iterator{} : iterator{this};
+}
+
+MemoryUsage Map::memory_usage() const {
+  namespace memory = otb::memory;
+
+  MemoryUsage usage;
+  usage.tile_table = memory::used_buckets(tiles_);
+  usage.table_slack = memory::empty_buckets(tiles_) + memory::empty_buckets(towns_) + memory::empty_buckets(waypoints_);
+
+  auto add_item = [&usage](const otb::Item &item) {
+    usage.strings += memory::item_string_bytes(item);
+    usage.custom_attributes += memory::item_attribute_bytes(item);
+  };
+  for (const auto &[coords, tile] : tiles_) {
+    usage.items += tile.items().size() * sizeof(otb::Item);
+    usage.container_slack += (tile.items().capacity() - tile.items().size()) * sizeof(otb::Item);
+    if (tile.ground()) {
+      add_item(*tile.ground());
+    }
+    for (const auto &item : tile.items()) {
+      add_item(item);
+    }
+  }
+
+  usage.container_items = contents.capacity() * sizeof(otb::Item);
+  contents.for_each(add_item);
+
+  usage.towns = memory::used_buckets(towns_);
+  for (const auto &[id, town] : towns_) {
+    usage.towns += memory::string_bytes(town.name);
+  }
+  usage.waypoints = memory::used_buckets(waypoints_);
+  for (const auto &[name, coords] : waypoints_) {
+    usage.waypoints += memory::string_bytes(name);
+  }
+  usage.type_index = types_.memory_usage();
+  return usage;
 }
 
 } // namespace otbm
@@ -1,15 +1,27 @@
 #pragma once
 
 #include "coords.h"
+#include "external.h"
+#include "index.h"
 #include "otb.h"
 #include "otbi.h"
+#include "pool.h"
 
+#include <algorithm>
+#include <bitset>
 #include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
 #include <tsl/robin_map.h>
 #include <utility>
+#include <vector>
 
 namespace otbm {
 
+constexpr auto MAP_MAX_LAYERS = 16;
+
 enum {
   TILESTATE_NONE = 0,
 
@@ -44,13 +56,46 @@ enum {
 
 class Tile {
 public:
-  explicit Tile(otb::Item ground, uint32_t flags) : ground{std::move(ground)}, flags{flags} {}
-  auto emplace_item(otb::Item &&item) { return items.emplace_back(std::forward<otb::Item>(item)); }
+  explicit Tile(uint32_t flags = TILESTATE_NONE) : flags_{flags} {}
+
+  void emplace_item(otb::Item &&item) {
+    update_flags(*item.type);
+    if (item.type->is_ground_tile()) {
+      ground_.emplace(std::move(item));
+    } else {
+      items_.emplace_back(std::move(item));
+    }
+  }
+
+  void add_flags(uint32_t flags) { flags_ |= flags; }
+  void reserve(size_t count) { items_.reserve(count); }
+
+  auto &ground() const { return ground_; }
+  auto &items() const { return items_; }
+  auto flags() const { return flags_; }
 
 private:
-  std::vector<otb::Item> items = {};
-  otb::Item ground;
-  uint32_t flags;
+  void update_flags(const otb::ItemType &type) {
+    if (type.block_solid()) {
+      flags_ |= TILESTATE_BLOCKSOLID;
+      if (not type.moveable()) {
+        flags_ |= TILESTATE_IMMOVABLEBLOCKSOLID;
+      }
+    }
+    if (type.block_path_find()) {
+      flags_ |= TILESTATE_BLOCKPATH;
+      if (not type.moveable()) {
+        flags_ |= TILESTATE_IMMOVABLEBLOCKPATH;
+      }
+    }
+    if (type.is_horizontal() or type.is_vertical()) {
+      flags_ |= TILESTATE_SUPPORTS_HANGABLE;
+    }
+  }
+
+  std::vector<otb::Item> items_ = {};
+  std::optional<otb::Item> ground_ = {};
+  uint32_t flags_;
 };
 
 struct Town {
@@ -65,16 +110,250 @@ using Tiles = tsl::robin_map<Coords, Tile>;
 using Towns = tsl::robin_map<uint32_t, Town>;
 using Waypoints = tsl::robin_map<std::string, Coords>;
 
+// Where a loaded map keeps its memory, in bytes.
+struct MemoryUsage {
+  // Buckets holding tiles, with each tile's flags, item vector object and ground item inline.
+  size_t tile_table = 0;
+  // Items stored in the tiles' item vectors.
+  size_t items = 0;
+  // Chunks holding the items inside containers, used or not.
+  size_t container_items = 0;
+  // Unused capacity of the tiles' item vectors.
+  size_t container_slack = 0;
+  // Heap storage of item texts, names and descriptions.
+  size_t strings = 0;
+  // Custom attribute tables with their keys and values.
+  size_t custom_attributes = 0;
+  // Town and waypoint tables with their names.
+  size_t towns = 0;
+  size_t waypoints = 0;
+  // Empty buckets of the tile, town and waypoint tables.
+  size_t table_slack = 0;
+  // Compressed position lists of the type index, when built.
+  size_t type_index = 0;
+
+  size_t total() const {
+    return tile_table + items + container_items + container_slack + strings + custom_attributes + towns + waypoints + table_slack + type_index;
+  }
+};
+
 class Map {
 public:
-  Map(Tiles &&tiles, Towns &&towns, Waypoints &&waypoints) : tiles{std::move(tiles)}, towns{std::move(towns)}, waypoints{std::move(waypoints)} {}
+  Map(Tiles &&tiles, Towns &&towns, Waypoints &&waypoints, Houses &&houses = {}, Spawns &&spawns = {}, otb::ItemPool &&contents = {},
+      ScriptIndex &&scripts = {}, TypeIndex &&types = {})
+      : tiles_{std::move(tiles)}, towns_{std::move(towns)}, waypoints_{std::move(waypoints)}, houses_{std::move(houses)}, spawns_{std::move(spawns)},
+        contents{std::move(contents)}, scripts_{std::move(scripts)}, types_{std::move(types)} {}
+
+  auto &tiles() const { return tiles_; }
+  auto &towns() const { return towns_; }
+  auto &waypoints() const { return waypoints_; }
+  auto &houses() const { return houses_; }
+  auto &spawns() const { return spawns_; }
+  auto &scripts() const { return scripts_; }
+  // Empty unless loaded with LoadOptions::index_types.
+  auto &types() const { return types_; }
+
+  // Computed by walking the tiles, without touching the allocator.
+  MemoryUsage memory_usage() const;
+
+  // Moves the tiles out, e.g. into another layout. Items inside containers stay in this map, which must outlive them; the script index is
+  // left pointing at the old tiles.
+  Tiles release_tiles() { return std::move(tiles_); }
 
 private:
-  Tiles tiles;
-  Towns towns;
-  Waypoints waypoints;
+  Tiles tiles_;
+  Towns towns_;
+  Waypoints waypoints_;
+  Houses houses_;
+  Spawns spawns_;
+  // Items inside containers, referenced by Item::contents.
+  otb::ItemPool contents;
+  ScriptIndex scripts_;
+  TypeIndex types_;
+};
+
+// Inclusive rectangle on the x/y plane.
+struct Rect {
+  constexpr bool contains(uint16_t x, uint16_t y) const { return x >= x0 and x <= x1 and y >= y0 and y <= y1; }
+  constexpr bool intersects(const Rect &rhs) const { return x0 <= rhs.x1 and rhs.x0 <= x1 and y0 <= rhs.y1 and rhs.y0 <= y1; }
+
+  uint16_t x0 = 0;
+  uint16_t y0 = 0;
+  uint16_t x1 = 0;
+  uint16_t y1 = 0;
+};
+
+struct LoadOptions : otb::LoadOptions {
+  // Only tiles inside any of these rectangles are loaded, empty means the whole floor.
+  std::vector<Rect> regions = {};
+  // Only tiles on these floors are loaded.
+  std::bitset<MAP_MAX_LAYERS> floors = std::bitset<MAP_MAX_LAYERS>{}.set();
+  // Load the spawn and house files named by the map, looked up next to it, on their own threads while the tiles are decoded.
+  bool external_files = true;
+  // Build Map::types(), the positions of every server id.
+  bool index_types = false;
+  // Called by load() with every tile as it is decoded, e.g. to render a minimap in the same pass.
+  std::function<void(const Coords &, const Tile &)> tile_visitor = {};
+  // Keep the tiles in the map. Turning it off with a tile_visitor streams the map through it in bounded memory; the script index is then
+  // left empty.
+  bool keep_tiles = true;
+  // Count the tiles, container items, towns and waypoints in the scanned node tree before decoding, so every table and vector is allocated
+  // once at its final size.
+  bool presize = true;
+  // Skip tiles and tile areas that fail to decode, reporting each as a SKIPPED_TILE or SKIPPED_TILE_AREA diagnostic with its offset, instead
+  // of failing the load on the first one. The file structure itself must still be sound.
+  bool lenient = false;
+
+  bool contains(const Coords &coords) const {
+    if (coords.z >= MAP_MAX_LAYERS or not floors[coords.z]) {
+      return false;
+    }
+    return regions.empty() or std::any_of(regions.begin(), regions.end(), [&](const Rect &rect) { return rect.contains(coords.x, coords.y); });
+  }
+
+  // Whether a tile area based at `base` may contain any tile accepted by `contains`.
+  bool overlaps_area(const Coords &base) const {
+    if (base.z >= MAP_MAX_LAYERS or not floors[base.z]) {
+      return false;
+    }
+    auto area = Rect{base.x, base.y, static_cast<uint16_t>(std::min(base.x + 0xFF, 0xFFFF)), static_cast<uint16_t>(std::min(base.y + 0xFF, 0xFFFF))};
+    return regions.empty() or std::any_of(regions.begin(), regions.end(), [&](const Rect &rect) { return rect.intersects(area); });
+  }
 };
 
-Map load(std::string_view filename, const otbi::Items &items);
+// How a map is split into shards: floors into groups, and each group into stripes along x.
+struct ShardLayout {
+  // First floor of every group but the first, ascending: {8} keeps floors 0-7 and 8-15 apart. Empty puts every floor in one group.
+  std::vector<uint8_t> floor_splits = {};
+  // Width of each stripe, a multiple of 256 so that tile areas starting at multiples of 256, as editors write them, are never split. 0 keeps
+  // each floor group in a single stripe.
+  uint16_t stripe_width = 0;
+  // Stripes per floor group; tiles past the last stripe belong to it.
+  uint16_t stripes = 1;
+  // Pin the thread building each shard to a NUMA node, taking nodes in turn, so the shard's memory is allocated on that node.
+  bool numa = false;
+
+  size_t count() const { return (floor_splits.size() + 1) * stripes; }
+
+  size_t shard(const Coords &coords) const {
+    auto group = static_cast<size_t>(std::upper_bound(floor_splits.begin(), floor_splits.end(), coords.z) - floor_splits.begin());
+    auto stripe = stripe_width ? std::min<size_t>(coords.x / stripe_width, stripes - 1u) : 0;
+    return group * stripes + stripe;
+  }
+
+  // Throws std::invalid_argument unless the layout is usable.
+  void validate() const;
+};
+
+struct Shard {
+  Tiles tiles = {};
+  // Items inside containers, referenced by Item::contents of this shard's tiles.
+  otb::ItemPool contents = {};
+  // NUMA node the shard was built on, or -1 when it was not pinned.
+  int numa_node = -1;
+};
+
+// A map whose tiles are split into independently allocated shards, so that each may be owned by a different thread. Towns, waypoints,
+// houses and spawns are shared.
+class ShardedMap {
+public:
+  ShardedMap(const ShardLayout &layout, std::vector<std::unique_ptr<Shard>> &&shards, Towns &&towns, Waypoints &&waypoints, Houses &&houses = {},
+             Spawns &&spawns = {}, ScriptIndex &&scripts = {}, TypeIndex &&types = {})
+      : layout_{layout}, shards{std::move(shards)}, towns_{std::move(towns)}, waypoints_{std::move(waypoints)}, houses_{std::move(houses)},
+        spawns_{std::move(spawns)}, scripts_{std::move(scripts)}, types_{std::move(types)} {}
+
+  auto &layout() const { return layout_; }
+  size_t size() const { return shards.size(); }
+  Shard &shard(size_t index) { return *shards[index]; }
+  const Shard &shard(size_t index) const { return *shards[index]; }
+  size_t shard_index(const Coords &coords) const { return layout_.shard(coords); }
+
+  // Finds a tile in whichever shard holds it, e.g. a neighbour across a shard boundary.
+  const Tile *find(const Coords &coords) const {
+    const auto &tiles = shards[shard_index(coords)]->tiles;
+    auto it = tiles.find(coords);
+    return it != tiles.end() ? &it->second : nullptr;
+  }
+
+  auto &towns() const { return towns_; }
+  auto &waypoints() const { return waypoints_; }
+  auto &houses() const { return houses_; }
+  auto &spawns() const { return spawns_; }
+  auto &scripts() const { return scripts_; }
+  auto &types() const { return types_; }
+
+private:
+  ShardLayout layout_;
+  std::vector<std::unique_ptr<Shard>> shards;
+  Towns towns_;
+  Waypoints waypoints_;
+  Houses houses_;
+  Spawns spawns_;
+  ScriptIndex scripts_;
+  TypeIndex types_;
+};
+
+Map load(std::string_view filename, const otbi::Items &items, const LoadOptions &options = {});
+// Loads a map straight into shards, each decoded by its own thread from the tile areas it covers.
+ShardedMap load_sharded(std::string_view filename, const otbi::Items &items, const ShardLayout &layout, const LoadOptions &options = {});
+
+// Decodes the tile area `node` of a map starting at `data` the way a lenient load() does and drops it, so that `diagnostics` receives what a
+// load would report about it: the tiles and areas it would skip, with their offsets, and its warnings. `visit` is called with every tile that
+// decodes. For checking a map without loading it.
+void check_tile_area(const otb::node &node, otb::iterator data, const otbi::Items &items, otb::DiagnosticSink &diagnostics,
+                     const std::function<void(const otb::node &, const Coords &)> &visit);
+
+// Reads the tiles of a map one at a time, for passes over a whole map that do not keep it. A tile area is decoded only when its first tile
+// is asked for and dropped when the reader moves past it, and the pages of the file behind it are given back, so memory stays bounded by the
+// largest area whatever the size of the map. The file is always mapped. Towns, waypoints, houses and spawns are skipped; of the options,
+// regions, floors, presize, lenient, stats and diagnostics apply.
+class TileReader {
+public:
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = std::pair<Coords, Tile>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type *;
+    using reference = value_type &;
+
+    iterator() = default;
+    explicit iterator(TileReader *reader) : reader{reader} {}
+
+    reference operator*() const { return reader->current(); }
+    pointer operator->() const { return &reader->current(); }
+    iterator &operator++() {
+      if (not reader->next()) {
+        reader = nullptr;
+      }
+      return *this;
+    }
+
+    bool operator==(const iterator &rhs) const { return reader == rhs.reader; }
+    bool operator!=(const iterator &rhs) const { return reader != rhs.reader; }
+
+  private:
+    TileReader *reader = nullptr;
+  };
+
+  TileReader(std::string_view filename, const otbi::Items &items, const LoadOptions &options = {});
+  ~TileReader();
+
+  TileReader(TileReader &&) noexcept;
+  TileReader &operator=(TileReader &&) noexcept;
+
+  // Moves to the next tile, or returns false once the map is done.
+  bool next();
+  // The tile next() moved to. It may be moved from, but the items inside its containers only live until the reader leaves its tile area.
+  std::pair<Coords, Tile> &current();
+
+  // Starts reading unless next() already did.
+  iterator begin();
+  iterator end() { return {}; }
+
+private:
+  struct State;
+  std::unique_ptr<State> state;
+};
 
 } // namespace otbm
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace otb {
+
+inline unsigned thread_count(unsigned requested) { return requested ? requested : std::max(1u, std::thread::hardware_concurrency()); }
+
+// Calls fn(i) for every i in [0, count) from up to `threads` threads (0 uses every hardware thread), each taking the next index as it becomes
+// free. The first exception thrown by fn is rethrown once every thread has stopped.
+template <class F> void parallel_for(size_t count, unsigned threads, F &&fn) {
+  auto workers = std::min<size_t>(thread_count(threads), count);
+  if (workers <= 1) {
+    for (size_t i = 0; i < count; ++i) {
+      fn(i);
+    }
+    return;
+  }
+
+  std::atomic<size_t> next{0};
+  std::exception_ptr error;
+  std::mutex error_mutex;
+
+  auto work = [&] {
+    try {
+      for (auto i = next++; i < count; i = next++) {
+        fn(i);
+      }
+    } catch (...) {
+      next = count;
+      auto lock = std::lock_guard{error_mutex};
+      if (not error) {
+        error = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> pool;
+  pool.reserve(workers - 1);
+  for (size_t i = 1; i < workers; ++i) {
+    pool.emplace_back(work);
+  }
+  work();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+} // namespace otb
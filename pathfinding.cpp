@@ -0,0 +1,206 @@
+#include "pathfinding.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+
+namespace otbm {
+
+namespace {
+
+constexpr auto CLOSED = std::numeric_limits<uint32_t>::max();
+
+struct Step {
+  int dx, dy;
+  uint32_t cost;
+};
+
+// Indexed by Direction.
+constexpr Step steps[] = {
+    {0, -1, Pathfinder::STRAIGHT_COST}, {1, 0, Pathfinder::STRAIGHT_COST},  {0, 1, Pathfinder::STRAIGHT_COST},   {-1, 0, Pathfinder::STRAIGHT_COST},
+    {-1, 1, Pathfinder::DIAGONAL_COST}, {1, 1, Pathfinder::DIAGONAL_COST}, {-1, -1, Pathfinder::DIAGONAL_COST}, {1, -1, Pathfinder::DIAGONAL_COST},
+};
+
+// Diagonal steps cost more than two straight steps, so the Manhattan distance never overestimates.
+uint32_t heuristic(int x, int y, int goal_x, int goal_y) { return static_cast<uint32_t>(std::abs(goal_x - x) + std::abs(goal_y - y)) * Pathfinder::STRAIGHT_COST; }
+
+} // namespace
+
+Pathfinder::Pathfinder(const Grid &grid, uint16_t radius)
+    : grid{grid}, radius_{radius}, side{2 * radius + 1}, sectors_per_side{side / Grid::SECTOR_SIZE + 2},
+      window_sectors(static_cast<size_t>(sectors_per_side * sectors_per_side)), stamp(static_cast<size_t>(side * side)),
+      cost(static_cast<size_t>(side * side)), estimate(static_cast<size_t>(side * side)), heap_index(static_cast<size_t>(side * side)),
+      parent(static_cast<size_t>(side * side)), heap{} {
+  heap.reserve(static_cast<size_t>(side * side));
+}
+
+bool Pathfinder::passable(int wx, int wy) const {
+  auto x = origin_x + wx;
+  auto y = origin_y + wy;
+  if (x < 0 or y < 0 or x > 0xFFFF or y > 0xFFFF) {
+    return false;
+  }
+
+  auto sector = window_sectors[static_cast<size_t>(((y >> Grid::SECTOR_BITS) - sector_origin_y) * sectors_per_side + (x >> Grid::SECTOR_BITS) - sector_origin_x)];
+  if (not sector) {
+    return false;
+  }
+
+  const auto &rows = use_pathable ? sector->pathable : sector->walkable;
+  return (rows[static_cast<size_t>(y & Grid::SECTOR_MASK)] >> (x & Grid::SECTOR_MASK) & 1) != 0;
+}
+
+void Pathfinder::heap_push(uint32_t cell) {
+  heap_index[cell] = static_cast<uint32_t>(heap.size());
+  heap.push_back(cell);
+  heap_update(cell);
+}
+
+void Pathfinder::heap_update(uint32_t cell) {
+  // Costs only ever decrease, so the cell can only move up.
+  auto i = heap_index[cell];
+  while (i > 0) {
+    auto up = (i - 1) / 2;
+    if (estimate[heap[up]] <= estimate[cell]) {
+      break;
+    }
+    heap[i] = heap[up];
+    heap_index[heap[i]] = i;
+    i = up;
+  }
+  heap[i] = cell;
+  heap_index[cell] = i;
+}
+
+uint32_t Pathfinder::heap_pop() {
+  auto top = heap.front();
+  auto last = heap.back();
+  heap.pop_back();
+
+  if (not heap.empty()) {
+    auto size = static_cast<uint32_t>(heap.size());
+    uint32_t i = 0;
+    while (true) {
+      auto child = 2 * i + 1;
+      if (child >= size) {
+        break;
+      }
+      if (child + 1 < size and estimate[heap[child + 1]] < estimate[heap[child]]) {
+        ++child;
+      }
+      if (estimate[last] <= estimate[heap[child]]) {
+        break;
+      }
+      heap[i] = heap[child];
+      heap_index[heap[i]] = i;
+      i = child;
+    }
+    heap[i] = last;
+    heap_index[last] = i;
+  }
+
+  heap_index[top] = CLOSED;
+  return top;
+}
+
+bool Pathfinder::find(const Coords &from, const Coords &to, std::vector<Direction> &path, const PathOptions &options) {
+  path.clear();
+  expanded_ = 0;
+
+  if (from.z != to.z or std::abs(to.x - from.x) > radius_ or std::abs(to.y - from.y) > radius_) {
+    return false;
+  }
+
+  if (++generation == 0) {
+    std::fill(stamp.begin(), stamp.end(), 0);
+    generation = 1;
+  }
+
+  use_pathable = not options.ignore_path_blockers;
+  origin_x = from.x - radius_;
+  origin_y = from.y - radius_;
+  sector_origin_x = std::max(origin_x, 0) >> Grid::SECTOR_BITS;
+  sector_origin_y = std::max(origin_y, 0) >> Grid::SECTOR_BITS;
+  for (int sy = 0; sy < sectors_per_side; ++sy) {
+    for (int sx = 0; sx < sectors_per_side; ++sx) {
+      auto x = (sector_origin_x + sx) << Grid::SECTOR_BITS;
+      auto y = (sector_origin_y + sy) << Grid::SECTOR_BITS;
+      const Grid::Sector *sector = nullptr;
+      if (x <= 0xFFFF and y <= 0xFFFF) {
+        sector = grid.sector(static_cast<uint16_t>(x), static_cast<uint16_t>(y), from.z);
+      }
+      window_sectors[static_cast<size_t>(sy * sectors_per_side + sx)] = sector;
+    }
+  }
+
+  auto goal_x = to.x - origin_x;
+  auto goal_y = to.y - origin_y;
+  if (not passable(goal_x, goal_y)) {
+    return false;
+  }
+
+  auto cell_of = [this](int x, int y) { return static_cast<uint32_t>(y * side + x); };
+  auto start = cell_of(radius_, radius_);
+  auto goal = cell_of(goal_x, goal_y);
+
+  heap.clear();
+  stamp[start] = generation;
+  cost[start] = 0;
+  estimate[start] = heuristic(radius_, radius_, goal_x, goal_y);
+  heap_push(start);
+
+  auto directions = options.allow_diagonal ? std::size(steps) : 4;
+  while (not heap.empty()) {
+    auto cell = heap_pop();
+    ++expanded_;
+
+    if (cell == goal) {
+      while (cell != start) {
+        auto direction = parent[cell];
+        path.push_back(static_cast<Direction>(direction));
+        const auto &step = steps[direction];
+        cell = static_cast<uint32_t>(static_cast<int>(cell) - step.dy * side - step.dx);
+      }
+      std::reverse(path.begin(), path.end());
+      return true;
+    }
+
+    auto x = static_cast<int>(cell) % side;
+    auto y = static_cast<int>(cell) / side;
+    for (size_t direction = 0; direction < directions; ++direction) {
+      const auto &step = steps[direction];
+      auto nx = x + step.dx;
+      auto ny = y + step.dy;
+      if (nx < 0 or ny < 0 or nx >= side or ny >= side) {
+        continue;
+      }
+
+      auto next = cell_of(nx, ny);
+      auto seen = stamp[next] == generation;
+      if (seen and heap_index[next] == CLOSED) {
+        continue;
+      }
+      if (not passable(nx, ny)) {
+        continue;
+      }
+
+      auto next_cost = cost[cell] + step.cost;
+      if (not seen) {
+        stamp[next] = generation;
+        cost[next] = next_cost;
+        estimate[next] = next_cost + heuristic(nx, ny, goal_x, goal_y);
+        parent[next] = static_cast<uint8_t>(direction);
+        heap_push(next);
+      } else if (next_cost < cost[next]) {
+        cost[next] = next_cost;
+        estimate[next] = next_cost + heuristic(nx, ny, goal_x, goal_y);
+        parent[next] = static_cast<uint8_t>(direction);
+        heap_update(next);
+      }
+    }
+  }
+
+  return false;
+}
+
+} // namespace otbm
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "coords.h"
+#include "grid.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace otbm {
+
+enum class Direction : uint8_t { NORTH, EAST, SOUTH, WEST, SOUTHWEST, SOUTHEAST, NORTHWEST, NORTHEAST };
+
+struct PathOptions {
+  // Also walk over tiles that only block path finding.
+  bool ignore_path_blockers = false;
+  bool allow_diagonal = true;
+};
+
+// Bounded A* over a Grid. Every buffer is sized once for the search window, so a Pathfinder is meant to be kept per thread and reused: queries
+// do not allocate as long as the output vector has enough capacity.
+//
+// Jump point search is not offered: diagonal steps cost more than two straight ones, which breaks the symmetry JPS relies on to prune neighbours.
+class Pathfinder {
+public:
+  static constexpr uint32_t STRAIGHT_COST = 10;
+  static constexpr uint32_t DIAGONAL_COST = 25;
+
+  // `radius` bounds the search to a square window of side 2 * radius + 1 centered at the start position.
+  explicit Pathfinder(const Grid &grid, uint16_t radius = 64);
+
+  // Finds a path between two positions on the same floor. On success, `path` holds the steps from `from` to `to`.
+  bool find(const Coords &from, const Coords &to, std::vector<Direction> &path, const PathOptions &options = {});
+
+  auto radius() const { return radius_; }
+  // Number of nodes expanded by the last query.
+  auto expanded() const { return expanded_; }
+
+private:
+  bool passable(int wx, int wy) const;
+  void heap_push(uint32_t cell);
+  void heap_update(uint32_t cell);
+  uint32_t heap_pop();
+
+  const Grid &grid;
+  uint16_t radius_;
+  int side;
+
+  // Sectors covering the window, resolved once per query.
+  int sector_origin_x = 0, sector_origin_y = 0, sectors_per_side;
+  std::vector<const Grid::Sector *> window_sectors;
+  int origin_x = 0, origin_y = 0;
+  bool use_pathable = true;
+
+  // Per-cell state, valid only where `stamp` matches the current query.
+  std::vector<uint32_t> stamp;
+  std::vector<uint32_t> cost;
+  std::vector<uint32_t> estimate;
+  std::vector<uint32_t> heap_index;
+  std::vector<uint8_t> parent;
+  std::vector<uint32_t> heap;
+  uint32_t generation = 0;
+  size_t expanded_ = 0;
+};
+
+} // namespace otbm
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "itemtype.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace otb {
+
+// Storage for items held by other items. Items are kept in chunks that never reallocate, so runs handed out stay put and each container's
+// contents are contiguous.
+class ItemPool {
+public:
+  static constexpr size_t CHUNK_SIZE = 4096;
+
+  ItemPool() = default;
+  ItemPool(ItemPool &&) = default;
+  ItemPool &operator=(ItemPool &&) = default;
+  ItemPool(const ItemPool &) = delete;
+  ItemPool &operator=(const ItemPool &) = delete;
+
+  // Makes room for a run of `count` items; the next `count` calls to push() fill it contiguously.
+  void reserve(size_t count) {
+    if (chunks.empty() or chunks.back().capacity() - chunks.back().size() < count) {
+      chunks.emplace_back().reserve(std::max(count, CHUNK_SIZE));
+    }
+  }
+
+  Item &push(Item &&item) {
+    size_ += 1;
+    return chunks.back().emplace_back(std::move(item));
+  }
+
+  size_t size() const { return size_; }
+
+  // Drops the items pushed since the pool held `size` items.
+  void truncate(size_t size) {
+    while (size_ > size) {
+      auto &chunk = chunks.back();
+      auto drop = std::min(size_ - size, chunk.size());
+      chunk.erase(chunk.end() - static_cast<ptrdiff_t>(drop), chunk.end());
+      size_ -= drop;
+      if (chunk.empty()) {
+        chunks.pop_back();
+      }
+    }
+  }
+
+  void clear() {
+    chunks.clear();
+    size_ = 0;
+  }
+
+  size_t capacity() const {
+    size_t capacity = 0;
+    for (const auto &chunk : chunks) {
+      capacity += chunk.capacity();
+    }
+    return capacity;
+  }
+
+  template <class F> void for_each(F &&f) const {
+    for (const auto &chunk : chunks) {
+      std::for_each(chunk.begin(), chunk.end(), f);
+    }
+  }
+
+private:
+  std::vector<std::vector<Item>> chunks = {};
+  size_t size_ = 0;
+};
+
+} // namespace otb
@@ -0,0 +1,303 @@
+#include "reader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+namespace otb {
+
+namespace {
+
+template <class T> T load_acquire(const T *at) { return __atomic_load_n(at, __ATOMIC_ACQUIRE); }
+template <class T> void store_release(T *at, T value) { __atomic_store_n(at, value, __ATOMIC_RELEASE); }
+
+} // namespace
+
+// Submission and completion queues of an io_uring instance, set up through the raw system calls so there is no liburing dependency.
+class ChunkReader::Ring {
+public:
+  explicit Ring(unsigned entries) {
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      return;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    auto single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes_address = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sq_ring == MAP_FAILED or cq_ring == MAP_FAILED or sqes_address == MAP_FAILED) {
+      if (sqes_address != MAP_FAILED) {
+        munmap(sqes_address, sqes_size);
+      }
+      unmap_rings();
+      close(fd);
+      fd = -1;
+      return;
+    }
+
+    auto sq = static_cast<char *>(sq_ring);
+    auto cq = static_cast<char *>(cq_ring);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    sqes = static_cast<io_uring_sqe *>(sqes_address);
+
+    // Kernels before 5.6 set up rings but fail every IORING_OP_READ with EINVAL; those are left to the pread threads.
+    if (not supports(IORING_OP_READ)) {
+      munmap(sqes, sqes_size);
+      unmap_rings();
+      close(fd);
+      fd = -1;
+    }
+  }
+
+  ~Ring() {
+    if (fd >= 0) {
+      munmap(sqes, sqes_size);
+      unmap_rings();
+      close(fd);
+    }
+  }
+
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+
+  bool valid() const { return fd >= 0; }
+
+  // Queues a read; the submission queue is only written by the owning thread, so the tail is tracked locally until submit().
+  void read(int file, char *into, unsigned length, size_t offset, uint64_t user_data) {
+    auto index = pending_tail & sq_mask;
+    auto &sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READ;
+    sqe.fd = file;
+    sqe.off = offset;
+    sqe.addr = reinterpret_cast<uint64_t>(into);
+    sqe.len = length;
+    sqe.user_data = user_data;
+    sq_array[index] = index;
+    ++pending_tail;
+    ++to_submit;
+  }
+
+  // Submits the queued reads and waits for at least `min_complete` completions.
+  void submit(unsigned min_complete) {
+    store_release(sq_tail, pending_tail);
+    while (true) {
+      auto submitted = syscall(__NR_io_uring_enter, fd, to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+      if (submitted >= 0) {
+        to_submit -= static_cast<unsigned>(submitted);
+        return;
+      }
+      if (errno != EINTR) {
+        throw std::system_error(errno, std::generic_category(), "io_uring_enter");
+      }
+    }
+  }
+
+  template <class F> void reap(F &&on_completion) {
+    auto head = *cq_head;
+    auto tail = load_acquire(cq_tail);
+    for (; head != tail; ++head) {
+      const auto &cqe = cqes[head & cq_mask];
+      on_completion(cqe.user_data, cqe.res);
+    }
+    store_release(cq_head, head);
+  }
+
+private:
+  // Asks the kernel whether it knows `op`; kernels too old to be probed predate IORING_OP_READ as well.
+  bool supports(unsigned op) const {
+    constexpr unsigned ops = 256;
+    auto storage = std::vector<char>(sizeof(io_uring_probe) + ops * sizeof(io_uring_probe_op));
+    auto probe = reinterpret_cast<io_uring_probe *>(storage.data());
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, ops) < 0) {
+      return false;
+    }
+    return op <= probe->last_op and (probe->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
+  }
+
+  void unmap_rings() {
+    if (cq_ring != MAP_FAILED and cq_ring != sq_ring) {
+      munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring != MAP_FAILED) {
+      munmap(sq_ring, sq_ring_size);
+    }
+  }
+
+  int fd = -1;
+  io_uring_params params = {};
+  void *sq_ring = MAP_FAILED;
+  void *cq_ring = MAP_FAILED;
+  size_t sq_ring_size = 0, cq_ring_size = 0, sqes_size = 0;
+  io_uring_sqe *sqes = nullptr;
+  io_uring_cqe *cqes = nullptr;
+  unsigned *sq_tail = nullptr, *sq_array = nullptr, *cq_head = nullptr, *cq_tail = nullptr;
+  unsigned sq_mask = 0, cq_mask = 0;
+  unsigned pending_tail = 0, to_submit = 0;
+};
+
+ChunkReader::ChunkReader(int fd, char *buffer, size_t size, size_t chunk_size, unsigned queue_depth)
+    : fd{fd}, buffer{buffer}, size{size}, chunk_size{std::max<size_t>(chunk_size, 1)}, queue_depth{std::max(queue_depth, 1u)}, done(chunks()) {
+  if (size == 0) {
+    return;
+  }
+
+  auto ring = std::make_shared<Ring>(this->queue_depth);
+  if (ring->valid()) {
+    io_uring = true;
+    threads.emplace_back([this, ring] {
+      try {
+        run_io_uring(*ring);
+      } catch (...) {
+        fail(std::current_exception());
+      }
+    });
+    return;
+  }
+
+  auto workers = std::min<size_t>(this->queue_depth, chunks());
+  for (size_t i = 0; i < workers; ++i) {
+    threads.emplace_back([this] { run_threads(); });
+  }
+}
+
+ChunkReader::~ChunkReader() {
+  stopping = true;
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+size_t ChunkReader::wait(size_t size) {
+  auto target = std::min(size, this->size);
+  auto available = watermark.load(std::memory_order_acquire);
+  if (available >= target) {
+    return available;
+  }
+
+  auto lock = std::unique_lock{mutex};
+  progress.wait(lock, [&] { return watermark.load(std::memory_order_acquire) >= target or error; });
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return watermark.load(std::memory_order_acquire);
+}
+
+void ChunkReader::read_chunk(size_t chunk, size_t done_bytes) {
+  auto offset = chunk * chunk_size + done_bytes;
+  auto end = std::min(size, (chunk + 1) * chunk_size);
+  while (offset < end) {
+    auto count = pread(fd, buffer + offset, end - offset, static_cast<off_t>(offset));
+    if (count < 0 and errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      throw std::system_error(count == 0 ? EIO : errno, std::generic_category(), "pread");
+    }
+    offset += static_cast<size_t>(count);
+  }
+}
+
+void ChunkReader::complete(size_t chunk) {
+  {
+    auto lock = std::lock_guard{mutex};
+    done[chunk] = true;
+    auto first_missing = watermark.load(std::memory_order_relaxed) / chunk_size;
+    while (first_missing < done.size() and done[first_missing]) {
+      ++first_missing;
+    }
+    watermark.store(std::min(size, first_missing * chunk_size), std::memory_order_release);
+  }
+  progress.notify_all();
+}
+
+void ChunkReader::fail(std::exception_ptr error) {
+  {
+    auto lock = std::lock_guard{mutex};
+    if (not this->error) {
+      this->error = std::move(error);
+    }
+    stopping = true;
+  }
+  progress.notify_all();
+}
+
+void ChunkReader::run_io_uring(Ring &ring) {
+  auto total = chunks();
+  size_t next = 0;
+  unsigned in_flight = 0;
+
+  // Once stopping, nothing new is queued but reads in flight are still waited for: the kernel writes into the buffer until they complete.
+  while (next < total or in_flight > 0) {
+    while (not stopping and in_flight < queue_depth and next < total) {
+      auto offset = next * chunk_size;
+      ring.read(fd, buffer + offset, static_cast<unsigned>(std::min(chunk_size, size - offset)), offset, next);
+      ++next;
+      ++in_flight;
+    }
+    if (in_flight == 0) {
+      break;
+    }
+
+    ring.submit(1);
+    ring.reap([&](uint64_t chunk, int32_t result) {
+      --in_flight;
+      if (stopping) {
+        return;
+      }
+      try {
+        auto expected = std::min(chunk_size, size - chunk * chunk_size);
+        // EINVAL is what a kernel that cannot read through the ring answers; pread reports a genuinely invalid read again.
+        if (result < 0 and result != -EINTR and result != -EAGAIN and result != -EINVAL) {
+          throw std::system_error(-result, std::generic_category(), "io_uring read");
+        }
+        // Short, interrupted or refused reads are rare for regular files; finish them synchronously.
+        if (result < 0 or static_cast<size_t>(result) < expected) {
+          read_chunk(chunk, result < 0 ? 0 : static_cast<size_t>(result));
+        }
+        complete(chunk);
+      } catch (...) {
+        fail(std::current_exception());
+      }
+    });
+  }
+}
+
+void ChunkReader::run_threads() {
+  while (not stopping) {
+    auto chunk = next_chunk++;
+    if (chunk >= chunks()) {
+      return;
+    }
+    try {
+      read_chunk(chunk);
+      complete(chunk);
+    } catch (...) {
+      fail(std::current_exception());
+      return;
+    }
+  }
+}
+
+} // namespace otb
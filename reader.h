@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace otb {
+
+// Reads a file into a buffer in the background, in chunks of `chunk_size` with up to `queue_depth` reads in flight, through io_uring or, where
+// the kernel does not offer it, a pool of threads calling pread. Readers of the buffer wait() for the prefix they need, so parsing can follow
+// the reads instead of waiting for the whole file.
+class ChunkReader {
+public:
+  ChunkReader(int fd, char *buffer, size_t size, size_t chunk_size, unsigned queue_depth);
+  // Stops issuing reads and waits for those in flight; the buffer must outlive the reader.
+  ~ChunkReader();
+
+  ChunkReader(const ChunkReader &) = delete;
+  ChunkReader &operator=(const ChunkReader &) = delete;
+
+  // Blocks until at least the first `size` bytes (or the whole file) are in the buffer and returns how many are. Rethrows read errors.
+  size_t wait(size_t size);
+
+  bool uses_io_uring() const { return io_uring; }
+
+private:
+  class Ring;
+
+  size_t chunks() const { return (size + chunk_size - 1) / chunk_size; }
+  void read_chunk(size_t chunk, size_t done = 0);
+  void complete(size_t chunk);
+  void fail(std::exception_ptr error);
+
+  void run_io_uring(Ring &ring);
+  void run_threads();
+
+  int fd;
+  char *buffer;
+  size_t size;
+  size_t chunk_size;
+  unsigned queue_depth;
+  bool io_uring = false;
+
+  // Length of the prefix of the buffer that has been read.
+  std::atomic<size_t> watermark = 0;
+  std::atomic<size_t> next_chunk = 0;
+  std::atomic<bool> stopping = false;
+
+  std::mutex mutex = {};
+  std::condition_variable progress = {};
+  std::vector<bool> done;
+  std::exception_ptr error = {};
+  std::vector<std::thread> threads = {};
+};
+
+} // namespace otb
@@ -0,0 +1,45 @@
+#include "minimap.h"
+#include "otbi.h"
+#include "otbm.h"
+
+#include <cstdlib>
+#include <fmt/format.h>
+#include <fstream>
+#include <string_view>
+
+int main(int argc, char **argv) {
+  if (argc < 5) {
+    fmt::print("usage: {:s} <items.otb> <map.otbm> <floor> <out.pam> [stream]\n", argv[0]);
+    return 2;
+  }
+
+  auto z = static_cast<uint8_t>(std::strtoul(argv[3], nullptr, 10));
+  auto stream = argc > 5 and std::string_view{argv[5]} == "stream";
+  auto items = otbi::load(argv[1]);
+
+  auto out = std::ofstream{argv[4], std::ios::binary};
+  if (not out) {
+    fmt::print("Could not open {:s} for writing.\n", argv[4]);
+    return 1;
+  }
+  auto writer = otbm::PamWriter{out};
+
+  if (stream) {
+    // The tiles are read one at a time and dropped as soon as their colors are taken.
+    auto collector = otbm::MinimapCollector{};
+    auto options = otbm::LoadOptions{};
+    options.floors.reset();
+    if (z < otbm::MAP_MAX_LAYERS) {
+      options.floors.set(z);
+    }
+    for (const auto &[coords, tile] : otbm::TileReader{argv[2], items, options}) {
+      collector.add(coords, tile);
+    }
+    collector.render(z, writer);
+  } else {
+    auto map = otbm::load(argv[2], items);
+    otbm::render_minimap(map, z, writer);
+  }
+
+  return out ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "otb.h"
+#include "stream.h"
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+// Attribute schemas: a list of fields, each binding an attribute id to how its payload is laid out and where it is stored. Decoders are generated
+// from the list at compile time as a 256-entry jump table indexed by attribute id. The field descriptors expose their id, wire type and member, so
+// an encoder can be generated from the same list. Decoding does not throw: a payload cut short or malformed is returned as INVALID, with the
+// position of the value that is, so map loads can skip what is broken without unwinding.
+namespace otb::schema {
+
+enum class framing {
+  // Attribute id followed by the payload, whose size is implied by the attribute (OTBM item attributes).
+  INLINE,
+  // Attribute id, 16-bit payload length, payload (OTBI item attributes).
+  LENGTH_PREFIXED,
+};
+
+// Outcome of decoding or skipping one attribute.
+enum class result : uint8_t {
+  DECODED,
+  // Not in the schema; nothing was consumed.
+  UNKNOWN,
+  // The payload is cut short or malformed, and `first` is left at the value that is.
+  INVALID,
+};
+
+namespace detail {
+
+template <class T> struct member_traits;
+template <class Class, class T> struct member_traits<T Class::*> {
+  using type = T;
+};
+
+} // namespace detail
+
+// Length policy of fixed-width attributes in length-prefixed framing.
+template <class Wire> constexpr bool valid_length(uint16_t length) { return length == sizeof(Wire); }
+
+// The handlers of every field return false, leaving `first` at the value that did not decode, for a payload cut short or malformed.
+
+// Fixed-width value stored as-is, optionally read as a different wire type.
+template <uint8_t Id, auto Member, class Wire = typename detail::member_traits<decltype(Member)>::type> struct value {
+  static constexpr uint8_t id = Id;
+  using wire_type = Wire;
+
+  template <framing Framing, class Target> static bool decode(Target &target, iterator &first, const iterator &last, uint16_t length) {
+    if constexpr (Framing == framing::LENGTH_PREFIXED) {
+      if (not valid_length<Wire>(length)) {
+        return false;
+      }
+    }
+    auto wire = Wire{};
+    if (not try_read(first, last, wire)) {
+      return false;
+    }
+    target.*Member = static_cast<typename detail::member_traits<decltype(Member)>::type>(wire);
+    return true;
+  }
+
+  template <framing Framing> static bool skip(iterator &first, const iterator &last, uint16_t length) {
+    if constexpr (Framing == framing::LENGTH_PREFIXED) {
+      if (not valid_length<Wire>(length)) {
+        return false;
+      }
+    }
+    return try_skip(first, last, sizeof(Wire));
+  }
+};
+
+// Text, its length being the attribute length or a 16-bit prefix of its own.
+template <uint8_t Id, auto Member> struct string {
+  static constexpr uint8_t id = Id;
+  using wire_type = std::string;
+
+  template <framing Framing, class Target> static bool decode(Target &target, iterator &first, const iterator &last, uint16_t length) {
+    if constexpr (Framing == framing::INLINE) {
+      if (not try_read(first, last, length)) {
+        return false;
+      }
+    }
+    return try_read_string(first, last, length, target.*Member);
+  }
+
+  template <framing Framing> static bool skip(iterator &first, const iterator &last, uint16_t length) {
+    if constexpr (Framing == framing::INLINE) {
+      if (not try_read(first, last, length)) {
+        return false;
+      }
+    }
+    return try_skip(first, last, length);
+  }
+};
+
+// Known attribute whose payload is not kept, `Size` bytes long when inline.
+template <uint8_t Id, uint16_t Size = 0> struct ignore {
+  static constexpr uint8_t id = Id;
+
+  template <framing Framing, class Target> static bool decode(Target &, iterator &first, const iterator &last, uint16_t length) {
+    return skip<Framing>(first, last, length);
+  }
+
+  template <framing Framing> static bool skip(iterator &first, const iterator &last, uint16_t length) {
+    return try_skip(first, last, Framing == framing::INLINE ? Size : length);
+  }
+};
+
+// Attribute needing its own code. `Decode` is called as Decode(target, first, last, length) and `Skip` as Skip(first, last, length), both
+// returning false as the handlers above do.
+template <uint8_t Id, auto Decode, auto Skip> struct custom {
+  static constexpr uint8_t id = Id;
+
+  template <framing Framing, class Target> static bool decode(Target &target, iterator &first, const iterator &last, uint16_t length) {
+    return Decode(target, first, last, length);
+  }
+
+  template <framing Framing> static bool skip(iterator &first, const iterator &last, uint16_t length) { return Skip(first, last, length); }
+};
+
+template <framing Framing, class Target, class... Fields> class decoder {
+public:
+  using decode_handler = bool (*)(Target &, iterator &, const iterator &, uint16_t);
+  using skip_handler = bool (*)(iterator &, const iterator &, uint16_t);
+
+  static constexpr bool known(uint8_t id) { return decode_table[id] != nullptr; }
+
+  // Decodes one attribute payload into `target`.
+  static result decode(uint8_t id, Target &target, iterator &first, const iterator &last, uint16_t length = 0) {
+    auto handler = decode_table[id];
+    if (not handler) {
+      return result::UNKNOWN;
+    }
+    return handler(target, first, last, length) ? result::DECODED : result::INVALID;
+  }
+
+  // Steps over one attribute payload without storing it.
+  static result skip(uint8_t id, iterator &first, const iterator &last, uint16_t length = 0) {
+    auto handler = skip_table[id];
+    if (not handler) {
+      return result::UNKNOWN;
+    }
+    return handler(first, last, length) ? result::DECODED : result::INVALID;
+  }
+
+private:
+  template <class Handler> static constexpr auto make_table(const Handler (&handlers)[sizeof...(Fields)]) {
+    constexpr uint8_t ids[] = {Fields::id...};
+    std::array<Handler, 256> table = {};
+    for (size_t i = 0; i < sizeof...(Fields); ++i) {
+      if (table[ids[i]] != nullptr) {
+        throw std::logic_error("Duplicate attribute id in schema.");
+      }
+      table[ids[i]] = handlers[i];
+    }
+    return table;
+  }
+
+  static constexpr decode_handler decode_handlers[] = {&Fields::template decode<Framing, Target>...};
+  static constexpr skip_handler skip_handlers[] = {&Fields::template skip<Framing>...};
+  static constexpr auto decode_table = make_table(decode_handlers);
+  static constexpr auto skip_table = make_table(skip_handlers);
+};
+
+} // namespace otb::schema
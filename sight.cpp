@@ -0,0 +1,125 @@
+#include "sight.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+
+namespace otbm {
+
+namespace {
+
+// Remembers the last sector looked up, lines rarely leave it.
+class Cursor {
+public:
+  explicit Cursor(const Grid &grid) : grid{grid} {}
+
+  const Grid::Sector *at(uint16_t x, uint16_t y, uint8_t z) {
+    auto key = Grid::key(x, y, z);
+    if (key != cached_key) {
+      cached_key = key;
+      cached = grid.sector(x, y, z);
+    }
+    return cached;
+  }
+
+  bool blocks_projectile(uint16_t x, uint16_t y, uint8_t z) {
+    auto sector = at(x, y, z);
+    return sector and Grid::test(sector->blocks_projectile, x, y);
+  }
+
+  bool occupied(uint16_t x, uint16_t y, uint8_t z) {
+    auto sector = at(x, y, z);
+    return sector and Grid::test(sector->occupied, x, y);
+  }
+
+private:
+  const Grid &grid;
+  uint32_t cached_key = std::numeric_limits<uint32_t>::max();
+  const Grid::Sector *cached = nullptr;
+};
+
+// Bits first through last of a sector row.
+constexpr uint32_t row_mask(int first, int last) {
+  auto upper = last == Grid::SECTOR_MASK ? ~0u : (1u << (last + 1)) - 1;
+  return upper & ~((1u << first) - 1);
+}
+
+// Tests a whole row segment a word at a time instead of tile by tile.
+bool row_clear(Cursor &cursor, int first, int last, uint16_t y, uint8_t z) {
+  while (first <= last) {
+    auto sector_last = std::min(last, first | Grid::SECTOR_MASK);
+    auto sector = cursor.at(static_cast<uint16_t>(first), y, z);
+    if (sector and (sector->blocks_projectile[y & Grid::SECTOR_MASK] & row_mask(first & Grid::SECTOR_MASK, sector_last & Grid::SECTOR_MASK)) != 0) {
+      return false;
+    }
+    first = sector_last + 1;
+  }
+  return true;
+}
+
+bool trace(Cursor &cursor, const Coords &from, const Coords &to) {
+  if (from == to) {
+    return true;
+  }
+
+  auto start = from.z > to.z ? to : from;
+  const auto &destination = from.z > to.z ? from : to;
+
+  if (start.y == destination.y) {
+    auto first = start.x < destination.x ? start.x + 1 : destination.x;
+    auto last = start.x < destination.x ? destination.x : start.x - 1;
+    if (not row_clear(cursor, first, last, start.y, start.z)) {
+      return false;
+    }
+    start.x = destination.x;
+  } else {
+    // Same stepping as the game server, so both agree on which tiles are crossed.
+    const int mx = start.x < destination.x ? 1 : start.x == destination.x ? 0 : -1;
+    const int my = start.y < destination.y ? 1 : -1;
+    const int a = destination.y - start.y;
+    const int b = start.x - destination.x;
+    const int c = -(a * destination.x + b * destination.y);
+
+    int x = start.x, y = start.y;
+    while (x != destination.x or y != destination.y) {
+      auto move_hor = std::abs(a * (x + mx) + b * y + c);
+      auto move_ver = std::abs(a * x + b * (y + my) + c);
+      auto move_cross = std::abs(a * (x + mx) + b * (y + my) + c);
+
+      auto step_y = y != destination.y and (x == destination.x or move_hor > move_ver or move_hor > move_cross);
+      auto step_x = x != destination.x and (y == destination.y or move_ver > move_hor or move_ver > move_cross);
+      y += step_y ? my : 0;
+      x += step_x ? mx : 0;
+
+      if (cursor.blocks_projectile(static_cast<uint16_t>(x), static_cast<uint16_t>(y), start.z)) {
+        return false;
+      }
+    }
+    start.x = destination.x;
+    start.y = destination.y;
+  }
+
+  for (; start.z != destination.z; ++start.z) {
+    if (cursor.occupied(start.x, start.y, start.z)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+bool line_of_sight(const Grid &grid, const Coords &from, const Coords &to) {
+  auto cursor = Cursor{grid};
+  return trace(cursor, from, to);
+}
+
+void line_of_sight(const Grid &grid, const Coords *from, const Coords *to, size_t count, bool *out) {
+  auto cursor = Cursor{grid};
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = trace(cursor, from[i], to[i]);
+  }
+}
+
+} // namespace otbm
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "coords.h"
+#include "grid.h"
+
+#include <cstddef>
+
+namespace otbm {
+
+// Whether a projectile thrown from `from` reaches `to`. Every tile stepped on along the line, `to` included, must not block projectiles. When the
+// positions are on different floors, the line is traced on the upper floor and every floor between it and the lower one must be empty at `to`.
+bool line_of_sight(const Grid &grid, const Coords &from, const Coords &to);
+
+// Evaluates `count` (from, to) pairs and writes one result per pair to `out`. The grid is only read, so any number of threads may run batches
+// concurrently; consecutive pairs close to each other share sector lookups.
+void line_of_sight(const Grid &grid, const Coords *from, const Coords *to, size_t count, bool *out);
+
+} // namespace otbm
@@ -0,0 +1,73 @@
+#include "stats.h"
+
+#include <chrono>
+#include <ctime>
+#include <sys/resource.h>
+
+#if defined(__GLIBC__) and (__GLIBC__ > 2 or (__GLIBC__ == 2 and __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define OTB_HAVE_MALLINFO2
+#endif
+
+namespace otb {
+
+namespace {
+
+double wall_now() { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+double cpu_now() {
+  timespec ts{};
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return static_cast<double>(ts.tv_sec) * 1e3 + static_cast<double>(ts.tv_nsec) / 1e6;
+}
+
+int64_t heap_in_use() {
+#ifdef OTB_HAVE_MALLINFO2
+  auto info = mallinfo2();
+  return static_cast<int64_t>(info.uordblks + info.hblkhd);
+#else
+  return 0;
+#endif
+}
+
+} // namespace
+
+PhaseTimer::PhaseTimer(PhaseTime *phase) : phase{phase} {
+  if (phase) {
+    wall_start = wall_now();
+    cpu_start = cpu_now();
+  }
+}
+
+void PhaseTimer::stop() {
+  if (phase) {
+    phase->wall_ms += wall_now() - wall_start;
+    phase->cpu_ms += cpu_now() - cpu_start;
+    phase = nullptr;
+  }
+}
+
+MemoryScope::MemoryScope(LoadStats *stats) : stats{stats} {
+  if (stats) {
+    allocations_start = stats->allocation_counter ? stats->allocation_counter() : 0;
+    heap_start = heap_in_use();
+  }
+}
+
+MemoryScope::~MemoryScope() {
+  if (not stats) {
+    return;
+  }
+
+  if (stats->allocation_counter) {
+    stats->allocations += stats->allocation_counter() - allocations_start;
+  }
+  stats->heap_bytes += heap_in_use() - heap_start;
+
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    stats->peak_rss = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+  }
+}
+
+} // namespace otb
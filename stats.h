@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+
+namespace otb {
+
+struct PhaseTime {
+  double wall_ms = 0;
+  // Process CPU time, so it includes every thread working on the phase.
+  double cpu_ms = 0;
+};
+
+struct LoadStats {
+  PhaseTime map_file = {};
+  PhaseTime tree_scan = {};
+  // Counting what the map holds before decoding it, when containers are presized. Sharded loads count on the shard threads, within decode.
+  PhaseTime count = {};
+  PhaseTime decode = {};
+  PhaseTime insertion = {};
+  // Time spent waiting for the spawn and house files after the tiles were done; zero when their loading was fully hidden behind the map.
+  PhaseTime external = {};
+
+  uint64_t bytes_scanned = 0;
+  uint64_t escape_bytes = 0;
+  uint64_t nodes = 0;
+  uint64_t tiles = 0;
+  uint64_t items = 0;
+  // Entries read from the house and spawn files named by the map.
+  uint64_t houses = 0;
+  uint64_t spawns = 0;
+  // Times the tile table grew, and times the item vector of a tile grew, while they were filled.
+  uint64_t rehashes = 0;
+  uint64_t reallocations = 0;
+
+  // A library cannot count allocations on its own. Applications that do (e.g. by replacing operator new) can point this at their counter, and
+  // `allocations` receives the difference over the load.
+  uint64_t (*allocation_counter)() = nullptr;
+  uint64_t allocations = 0;
+  // Growth of bytes in use by malloc over the load, where the C library reports it.
+  int64_t heap_bytes = 0;
+  // Peak resident set size of the process at the end of the load.
+  uint64_t peak_rss = 0;
+};
+
+// Adds the wall and CPU time between construction and stop() (or destruction) to a phase. Does nothing for a null phase.
+class PhaseTimer {
+public:
+  explicit PhaseTimer(PhaseTime *phase);
+  ~PhaseTimer() { stop(); }
+
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+  void stop();
+
+private:
+  PhaseTime *phase;
+  double wall_start = 0;
+  double cpu_start = 0;
+};
+
+// Records the memory figures of LoadStats over the lifetime of a top-level load. Does nothing for null stats.
+class MemoryScope {
+public:
+  explicit MemoryScope(LoadStats *stats);
+  ~MemoryScope();
+
+  MemoryScope(const MemoryScope &) = delete;
+  MemoryScope &operator=(const MemoryScope &) = delete;
+
+private:
+  LoadStats *stats;
+  uint64_t allocations_start = 0;
+  int64_t heap_start = 0;
+};
+
+} // namespace otb
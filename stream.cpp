@@ -1,27 +1,132 @@
 #include "stream.h"
 
-#include <iostream>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// First ESCAPE byte in [first, last), or last.
+otb::iterator find_escape(otb::iterator first, const otb::iterator last) {
+#if defined(__AVX2__)
+  const auto escape = _mm256_set1_epi8(otb::detail::ESCAPE);
+  auto mask_of = [&](otb::iterator at) {
+    auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(at));
+    return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, escape)));
+  };
+
+  for (; last - first >= 64; first += 64) {
+    auto low = mask_of(first);
+    auto high = mask_of(first + 32);
+    if ((low | high) != 0) {
+      return first + (low != 0 ? __builtin_ctz(low) : 32 + __builtin_ctz(high));
+    }
+  }
+  for (; last - first >= 32; first += 32) {
+    if (auto mask = mask_of(first)) {
+      return first + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__SSE2__)
+  const auto escape = _mm_set1_epi8(otb::detail::ESCAPE);
+  auto mask_of = [&](otb::iterator at) {
+    auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(at));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, escape)));
+  };
+
+  for (; last - first >= 64; first += 64) {
+    auto mask = mask_of(first) | mask_of(first + 16) << 16 | static_cast<uint64_t>(mask_of(first + 32)) << 32 | static_cast<uint64_t>(mask_of(first + 48)) << 48;
+    if (mask != 0) {
+      return first + __builtin_ctzll(mask);
+    }
+  }
+  for (; last - first >= 16; first += 16) {
+    if (auto mask = mask_of(first)) {
+      return first + __builtin_ctz(mask);
+    }
+  }
+#endif
+  return std::find(first, last, otb::detail::ESCAPE);
+}
+
+// Dense escapes would make every search stop after a few bytes, so each escape is followed by a short stretch handled a byte at a time. Returns
+// null when the data ends first.
+template <bool Copy> otb::iterator unescape(otb::iterator first, const otb::iterator &last, size_t len, char *out) {
+  constexpr size_t SCALAR_STRETCH = 16;
+
+  while (len > 0) {
+    auto run_end = find_escape(first, first + static_cast<ptrdiff_t>(std::min(len, static_cast<size_t>(last - first))));
+    auto run = static_cast<size_t>(run_end - first);
+    if constexpr (Copy) {
+      std::memcpy(out, first, run);
+      out += run;
+    }
+    first = run_end;
+    len -= run;
+
+    auto stretch = std::min(len, SCALAR_STRETCH);
+    if (static_cast<size_t>(last - first) >= 2 * stretch) {
+      // Room for the worst case of every byte being escaped, so no bounds checks are needed.
+      for (len -= stretch; stretch > 0; --stretch) {
+        first += *first == otb::detail::ESCAPE;
+        if constexpr (Copy) {
+          *out++ = *first;
+        }
+        ++first;
+      }
+      continue;
+    }
+
+    for (; stretch > 0; --stretch, --len) {
+      if (first == last or (*first == otb::detail::ESCAPE and ++first == last)) {
+        return nullptr;
+      }
+      if constexpr (Copy) {
+        *out++ = *first;
+      }
+      ++first;
+    }
+  }
+  return first;
+}
+
+} // namespace
+
+otb::iterator try_unescape(otb::iterator first, const otb::iterator &last, size_t len, char *out) {
+  return out ? unescape<true>(first, last, len, out) : unescape<false>(first, last, len, out);
+}
+
+otb::iterator unescape(otb::iterator first, const otb::iterator &last, size_t len, char *out) {
+  if (auto end = try_unescape(first, last, len, out)) {
+    return end;
+  }
+  throw std::invalid_argument("Not enough bytes to read.");
+}
 
 std::string read_string(otb::iterator &first, const otb::iterator &last, int len) {
   if (last - first < len) {
     throw std::invalid_argument("Not enough bytes to read as string.");
   }
 
-  std::string out;
-  out.reserve(len);
+  std::string out(static_cast<size_t>(std::max(len, 0)), '\0');
+  first = unescape(first, last, out.size(), out.data());
+  return out;
+}
 
-  auto start = first;
-  auto end = first + len;
-  while (start < end) {
-    if (*start == otb::detail::ESCAPE) {
-      ++start, ++end;
-    }
-    out.push_back(*start);
-    ++start;
+bool try_read_string(otb::iterator &first, const otb::iterator &last, size_t len, std::string &out) {
+  if (static_cast<size_t>(last - first) < len) {
+    return false;
   }
 
+  out.resize(len);
+  auto end = try_unescape(first, last, len, out.data());
+  if (not end) {
+    return false;
+  }
   first = end;
-  return out;
+  return true;
 }
 
 void skip(otb::iterator &first, const otb::iterator &last, const int len) {
@@ -29,14 +134,5 @@ void skip(otb::iterator &first, const otb::iterator &last, const int len) {
     throw std::invalid_argument("Not enough bytes to skip.");
   }
 
-  auto start = first;
-  auto end = first + len;
-  while (start < end) {
-    if (*start == otb::detail::ESCAPE) {
-      ++start, ++end;
-    }
-    ++start;
-  }
-
-  first = end;
-}
\ No newline at end of file
+  first = unescape(first, last, static_cast<size_t>(std::max(len, 0)), nullptr);
+}
@@ -2,28 +2,69 @@
 
 #include "otb.h"
 
-template <class T> auto read(otb::iterator &first, const otb::iterator &last) {
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+// Copies `len` unescaped bytes starting at `first` into `out`, or steps over them when `out` is null, and returns the position past them. Escape
+// bytes are searched a block of 16 to 64 bytes at a time and the runs between them copied whole. Throws when the data ends first.
+otb::iterator unescape(otb::iterator first, const otb::iterator &last, size_t len, char *out);
+// As unescape, but returns null instead of throwing when the data ends first.
+otb::iterator try_unescape(otb::iterator first, const otb::iterator &last, size_t len, char *out);
+
+template <class T> T read(otb::iterator &first, const otb::iterator &last) {
+  static_assert(std::is_trivially_copyable_v<T>);
   constexpr decltype(last - first) len = sizeof(T);
 
-  std::string buf;
-  buf.reserve(len);
+  T out;
+  auto buf = reinterpret_cast<char *>(&out);
+
+  // Fast path: no escape byte within the value, copy it whole.
+  if (last - first >= len and std::find(first, first + len, otb::detail::ESCAPE) == first + len) {
+    std::memcpy(buf, first, len);
+    first += len;
+    return out;
+  }
+
+  first = unescape(first, last, sizeof(T), buf);
+  return out;
+}
+
+// Reads that report data cut short by returning false instead of throwing, for decode loops that must not unwind. `first` is left unchanged
+// on failure.
+template <class T> bool try_read(otb::iterator &first, const otb::iterator &last, T &out) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  constexpr decltype(last - first) len = sizeof(T);
 
-  while (buf.size() < len and first < last) {
-    if (*first == otb::detail::ESCAPE) {
-      ++first;
-    }
-    buf.push_back(*first);
-    ++first;
+  auto buf = reinterpret_cast<char *>(&out);
+  if (last - first >= len and std::find(first, first + len, otb::detail::ESCAPE) == first + len) {
+    std::memcpy(buf, first, len);
+    first += len;
+    return true;
   }
 
-  if (buf.size() < len) {
-    throw std::invalid_argument("Not enough bytes to read.");
+  auto end = try_unescape(first, last, sizeof(T), buf);
+  if (not end) {
+    return false;
   }
+  first = end;
+  return true;
+}
 
-  T out;
-  std::copy(buf.begin(), buf.end(), reinterpret_cast<char *>(&out));
-  return out;
+inline bool try_skip(otb::iterator &first, const otb::iterator &last, size_t len) {
+  auto end = try_unescape(first, last, len, nullptr);
+  if (not end) {
+    return false;
+  }
+  first = end;
+  return true;
 }
 
 std::string read_string(otb::iterator &first, const otb::iterator &last, int len);
+// As read_string, into `out`, but returns false instead of throwing when the data ends first. `first` is then left unchanged and `out` holds
+// unspecified text.
+bool try_read_string(otb::iterator &first, const otb::iterator &last, size_t len, std::string &out);
 void skip(otb::iterator &first, const otb::iterator &last, int len);
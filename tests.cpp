@@ -0,0 +1,404 @@
+#include "attributes.h"
+#include "digest.h"
+#include "otbi.h"
+#include "otbm.h"
+#include "validation.h"
+#include "wire.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Every allocation made through operator new is counted, so tests can check code that should not allocate.
+namespace {
+std::atomic<uint64_t> allocation_count{0};
+uint64_t allocations() { return allocation_count.load(std::memory_order_relaxed); }
+} // namespace
+
+void *operator new(size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (auto pointer = std::malloc(size ? size : 1)) {
+    return pointer;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, size_t) noexcept { std::free(pointer); }
+
+namespace {
+
+constexpr uint16_t GROUND = 100;
+constexpr uint16_t PLAIN = 101;
+constexpr uint16_t VIAL = 102;
+constexpr uint16_t SPLASH = 103;
+// What maps hold in place of the persistent fire field, and the field itself.
+constexpr uint16_t FIREFIELD = 1487;
+constexpr uint16_t FIREFIELD_PERSISTENT = 1492;
+
+otb::ItemType item_type(uint16_t id, otb::item_group group) {
+  return {"", "", 0, 0, id, static_cast<uint16_t>(id + 1000), 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, group, otb::item_type::NONE};
+}
+
+// A small item table built in memory, so tests need no items.otb.
+otbi::Items make_items() {
+  std::vector<otb::ItemType> types;
+  types.push_back(item_type(GROUND, otb::item_group::GROUND));
+  types.push_back(item_type(PLAIN, otb::item_group::NONE));
+  types.push_back(item_type(VIAL, otb::item_group::FLUID));
+  types.push_back(item_type(SPLASH, otb::item_group::SPLASH));
+  types.push_back(item_type(FIREFIELD_PERSISTENT, otb::item_group::NONE));
+  return otbi::Items{std::move(types)};
+}
+
+// Writes an OTBM file byte by byte, escaping as it goes, with the map data node open for tile areas, towns and waypoints.
+class MapWriter {
+public:
+  MapWriter(uint16_t width, uint16_t height) {
+    start(0);
+    u32(2);
+    u16(width);
+    u16(height);
+    u32(3);
+    u32(57);
+    start(otbm::NODETYPE_MAP_DATA);
+  }
+
+  void byte(uint8_t value) {
+    auto c = static_cast<char>(value);
+    if (c == otb::detail::ESCAPE or c == otb::detail::START or c == otb::detail::END) {
+      out.push_back(otb::detail::ESCAPE);
+    }
+    out.push_back(c);
+  }
+  void u16(uint16_t value) {
+    byte(static_cast<uint8_t>(value));
+    byte(static_cast<uint8_t>(value >> 8));
+  }
+  void u32(uint32_t value) {
+    u16(static_cast<uint16_t>(value));
+    u16(static_cast<uint16_t>(value >> 16));
+  }
+  void start(uint8_t type) {
+    out.push_back(otb::detail::START);
+    byte(type);
+  }
+  void end() { out.push_back(otb::detail::END); }
+
+  void start_area(uint16_t x, uint16_t y, uint8_t z) {
+    start(otbm::NODETYPE_TILE_AREA);
+    u16(x);
+    u16(y);
+    byte(z);
+  }
+  // A tile with a ground, left open for its items.
+  void start_tile(uint8_t dx, uint8_t dy, uint16_t ground = GROUND) {
+    start(otbm::NODETYPE_TILE);
+    byte(dx);
+    byte(dy);
+    byte(otbm::ATTR_ITEM);
+    u16(ground);
+  }
+
+  // Offset of the next byte written.
+  size_t offset() const { return out.size(); }
+
+  // Closes the map data and root nodes and writes the file.
+  void save(const std::filesystem::path &path) {
+    end();
+    end();
+    std::ofstream{path, std::ios::binary}.write(out.data(), static_cast<std::streamsize>(out.size()));
+  }
+
+private:
+  std::string out = "OTBM";
+};
+
+// A file in the temporary directory, removed with the object.
+class TempFile {
+public:
+  explicit TempFile(std::string_view name) : path_{std::filesystem::temp_directory_path() / fmt::format("otbm-test-{:s}.otbm", name)} {}
+  ~TempFile() {
+    auto error = std::error_code{};
+    std::filesystem::remove(path_, error);
+  }
+
+  TempFile(const TempFile &) = delete;
+  TempFile &operator=(const TempFile &) = delete;
+
+  auto &path() const { return path_; }
+  auto name() const { return path_.string(); }
+
+private:
+  std::filesystem::path path_;
+};
+
+class CollectingSink final : public otb::DiagnosticSink {
+public:
+  void report(const otb::Diagnostic &diagnostic) override { diagnostics.push_back(diagnostic); }
+
+  std::vector<otb::Diagnostic> diagnostics = {};
+};
+
+bool check(bool condition, std::string_view what) {
+  if (not condition) {
+    fmt::print("  failed: {:s}\n", what);
+  }
+  return condition;
+}
+
+// Areas of 256x256 tiles with a ground each, half of them with a plain item inline and two as nodes.
+void write_plain_map(const std::filesystem::path &path, size_t areas) {
+  auto map = MapWriter{static_cast<uint16_t>(areas * 256), 256};
+  for (size_t area = 0; area < areas; ++area) {
+    map.start_area(static_cast<uint16_t>(area * 256), 0, 7);
+    for (unsigned x = 0; x < 256; ++x) {
+      for (unsigned y = 0; y < 256; ++y) {
+        map.start_tile(static_cast<uint8_t>(x), static_cast<uint8_t>(y));
+        if ((x + y) % 2 == 0) {
+          map.byte(otbm::ATTR_ITEM);
+          map.u16(PLAIN);
+          for (auto i = 0; i < 2; ++i) {
+            map.start(otbm::NODETYPE_ITEM);
+            map.u16(PLAIN);
+            map.end();
+          }
+        }
+        map.end();
+      }
+    }
+    map.end();
+  }
+  map.save(path);
+}
+
+// Decoding tiles without item attributes allocates nothing once the decoder is warm but the presized item vector of each tile holding items.
+bool test_allocations() {
+  auto items = make_items();
+  auto file = TempFile{"allocations"};
+  constexpr size_t AREAS = 4;
+  write_plain_map(file.path(), AREAS);
+
+  std::vector<uint64_t> counts;
+  std::vector<uint64_t> holding;
+  counts.reserve(AREAS);
+  holding.reserve(AREAS);
+  auto options = otbm::LoadOptions{};
+  options.keep_tiles = false;
+  options.external_files = false;
+  options.tile_visitor = [&](const otbm::Coords &coords, const otbm::Tile &tile) {
+    if (coords.x % 256 == 0 and coords.y == 0) {
+      counts.push_back(allocations());
+      holding.push_back(0);
+    }
+    holding.back() += not tile.items().empty();
+  };
+  otbm::load(file.name(), items, options);
+
+  auto ok = check(counts.size() == AREAS, "every area is visited");
+  // The first area also sets up the decoder's scratch buffers.
+  for (size_t area = 1; area < counts.size(); ++area) {
+    auto made = counts[area] - counts[area - 1];
+    ok &= check(made == holding[area], fmt::format("area {:d} made {:d} allocations for {:d} tiles holding items", area, made, holding[area]));
+  }
+  return ok;
+}
+
+// Fluids reach clients in the colors clients number them by.
+bool test_fluids() {
+  auto items = make_items();
+  auto tile = otbm::Tile{};
+  for (auto [id, fluid] : {std::pair{VIAL, 10}, std::pair{SPLASH, 7}}) {
+    auto item = otb::Item{&items.at(id)};
+    item.subtype(static_cast<uint8_t>(fluid));
+    tile.emplace_item(std::move(item));
+  }
+  std::vector<uint8_t> out;
+  otbm::describe_tile(tile, out);
+
+  // The splash placed last is sent first, client id 1103 in purple, then the vial of life fluid, client id 1102 in red.
+  constexpr std::array<uint8_t, 7> expected = {2, 0x4F, 0x04, 2, 0x4E, 0x04, 5};
+  return check(std::equal(out.begin(), out.end(), expected.begin(), expected.end()), "client colors of life fluid and a purple splash");
+}
+
+// Tiles of an area crossing a stripe boundary are found in the shard of their own stripe.
+bool test_shards() {
+  auto items = make_items();
+  auto file = TempFile{"shards"};
+  auto map = MapWriter{612, 16};
+  for (auto base : {uint16_t{0}, uint16_t{100}, uint16_t{356}}) {
+    map.start_area(base, 0, 7);
+    for (unsigned dx = 0; dx < 256; dx += 5) {
+      for (unsigned dy = 0; dy < 16; dy += 3) {
+        map.start_tile(static_cast<uint8_t>(dx), static_cast<uint8_t>(dy));
+        map.end();
+      }
+    }
+    map.end();
+  }
+  map.save(file.path());
+
+  auto options = otbm::LoadOptions{};
+  options.external_files = false;
+  auto whole = otbm::load(file.name(), items, options);
+  auto layout = otbm::ShardLayout{};
+  layout.stripe_width = 256;
+  layout.stripes = 3;
+  auto sharded = otbm::load_sharded(file.name(), items, layout, options);
+
+  size_t sharded_tiles = 0, found = 0;
+  for (size_t i = 0; i < sharded.size(); ++i) {
+    sharded_tiles += sharded.shard(i).tiles.size();
+  }
+  for (const auto &[coords, tile] : whole.tiles()) {
+    found += sharded.find(coords) != nullptr;
+  }
+  return check(sharded_tiles == whole.tiles().size(), "the shards hold every tile once") and
+         check(found == whole.tiles().size(), "every tile is found in its shard");
+}
+
+// A cut short item attribute skips its tile in a lenient load, reported at the value that is cut short, and fails a strict load.
+bool test_truncated_attribute() {
+  auto items = make_items();
+  auto file = TempFile{"truncated-attribute"};
+  auto map = MapWriter{16, 16};
+  map.start_area(0, 0, 7);
+  map.start_tile(0, 0);
+  map.start(otbm::NODETYPE_ITEM);
+  map.u16(PLAIN);
+  map.byte(otbm::ATTR_ACTION_ID);
+  auto cut_at = map.offset();
+  map.byte(7);
+  map.end();
+  map.end();
+  map.start_tile(1, 0);
+  map.end();
+  map.end();
+  map.save(file.path());
+
+  auto sink = CollectingSink{};
+  auto options = otbm::LoadOptions{};
+  options.external_files = false;
+  options.lenient = true;
+  options.diagnostics = &sink;
+  auto loaded = otbm::load(file.name(), items, options);
+
+  auto ok = check(loaded.tiles().size() == 1, "the broken tile is skipped and the other kept");
+  ok &= check(sink.diagnostics.size() == 1, "one diagnostic");
+  if (not sink.diagnostics.empty()) {
+    const auto &diagnostic = sink.diagnostics.front();
+    ok &= check(diagnostic.code == otb::Warning::SKIPPED_TILE, "the tile is reported as skipped");
+    ok &= check(diagnostic.value == static_cast<uint32_t>(otb::DecodeError::INVALID_ITEM_ATTRIBUTE), "as an invalid item attribute");
+    ok &= check(diagnostic.attribute == otbm::ATTR_ACTION_ID and diagnostic.item_id == PLAIN, "with its attribute and item");
+    ok &= check(diagnostic.offset == cut_at, fmt::format("at offset {:d}, got {:d}", cut_at, diagnostic.offset));
+  }
+
+  options.lenient = false;
+  auto threw = false;
+  try {
+    otbm::load(file.name(), items, options);
+  } catch (const std::invalid_argument &) {
+    threw = true;
+  }
+  return ok and check(threw, "a strict load fails");
+}
+
+// Tile hashes tell which tile of a changed area changed.
+bool test_digest() {
+  auto write = [](const std::filesystem::path &path, uint16_t changed_ground) {
+    auto map = MapWriter{256, 16};
+    map.start_area(0, 0, 7);
+    for (uint8_t dx = 0; dx < 8; ++dx) {
+      map.start_tile(dx, 0, dx == 3 ? changed_ground : GROUND);
+      map.end();
+    }
+    map.end();
+    map.save(path);
+  };
+  auto from = TempFile{"digest-from"}, to = TempFile{"digest-to"};
+  write(from.path(), GROUND);
+  write(to.path(), FIREFIELD_PERSISTENT);
+
+  auto base = otbm::Coords{0, 0, 7};
+  auto from_tiles = otbm::digest_tiles(from.name(), base);
+  auto to_tiles = otbm::digest_tiles(to.name(), base);
+  auto ok = check(from_tiles.size() == 8 and to_tiles.size() == 8, "every tile is hashed");
+  ok &= check(otbm::digest_tiles(from.name(), {256, 0, 7}).empty(), "no hashes for a missing area");
+  if (not ok) {
+    return false;
+  }
+
+  std::vector<otbm::Coords> changed;
+  for (size_t i = 0; i < from_tiles.size(); ++i) {
+    if (from_tiles[i].hash != to_tiles[i].hash) {
+      changed.push_back(from_tiles[i].coords);
+    }
+  }
+  auto diff = otbm::diff(from.name(), to.name());
+  ok &= check(changed.size() == 1 and changed.front() == otbm::Coords{3, 0, 7}, "one tile hash differs, the changed tile's");
+  ok &= check(diff.tiles.size() == 1 and diff.tiles.front().kind == otbm::TileChange::CHANGED and diff.tiles.front().coords == otbm::Coords{3, 0, 7},
+              "diff agrees");
+  return ok;
+}
+
+// What a load accepts passes validation: house tiles without a house, and items stored by the id of their non-persistent form.
+bool test_validation() {
+  auto items = make_items();
+  auto file = TempFile{"validation"};
+  auto map = MapWriter{16, 16};
+  map.start_area(0, 0, 7);
+  map.start(otbm::NODETYPE_HOUSETILE);
+  map.byte(0);
+  map.byte(0);
+  map.u32(0);
+  map.byte(otbm::ATTR_ITEM);
+  map.u16(GROUND);
+  map.byte(otbm::ATTR_ITEM);
+  map.u16(FIREFIELD);
+  map.end();
+  map.end();
+  map.save(file.path());
+
+  auto options = otbm::LoadOptions{};
+  options.external_files = false;
+  auto loaded = otbm::load(file.name(), items, options);
+  auto errors = otbm::validate(file.name(), items, 1);
+  for (const auto &error : errors) {
+    fmt::print("  {:#010x}: {:s}\n", error.offset, error.message);
+  }
+  return check(loaded.tiles().size() == 1, "the map loads") and check(errors.empty(), "and validates");
+}
+
+struct Test {
+  std::string_view name;
+  bool (*run)();
+};
+
+constexpr Test TESTS[] = {
+    {"allocations", test_allocations}, {"fluids", test_fluids}, {"shards", test_shards}, {"truncated-attribute", test_truncated_attribute},
+    {"digest", test_digest},           {"validation", test_validation},
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+  auto failed = 0;
+  for (const auto &test : TESTS) {
+    if (argc > 1 and test.name != argv[1]) {
+      continue;
+    }
+    auto ok = test.run();
+    fmt::print("{:s}: {:s}\n", test.name, ok ? "ok" : "FAILED");
+    failed += not ok;
+  }
+  return failed == 0 ? 0 : 1;
+}
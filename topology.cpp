@@ -0,0 +1,71 @@
+#include "topology.h"
+
+#include <fmt/format.h>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+
+namespace otb {
+
+namespace {
+
+// Parses a sysfs list such as "0-3,8-11".
+std::vector<unsigned> parse_list(const std::string &list) {
+  std::vector<unsigned> out;
+  size_t pos = 0;
+  while (pos < list.size()) {
+    size_t used = 0;
+    auto first = std::stoul(list.substr(pos), &used);
+    auto last = first;
+    pos += used;
+    if (pos < list.size() and list[pos] == '-') {
+      last = std::stoul(list.substr(pos + 1), &used);
+      pos += used + 1;
+    }
+    for (auto i = first; i <= last; ++i) {
+      out.push_back(static_cast<unsigned>(i));
+    }
+    if (pos < list.size() and list[pos] == ',') {
+      ++pos;
+    } else {
+      break;
+    }
+  }
+  return out;
+}
+
+std::string read_line(const std::string &filename) {
+  std::string line;
+  if (auto file = std::ifstream{filename}) {
+    std::getline(file, line);
+  }
+  return line;
+}
+
+} // namespace
+
+std::vector<std::vector<unsigned>> numa_nodes() {
+  std::vector<std::vector<unsigned>> nodes;
+  for (auto node : parse_list(read_line("/sys/devices/system/node/online"))) {
+    auto cpus = parse_list(read_line(fmt::format("/sys/devices/system/node/node{:d}/cpulist", node)));
+    // Memory-only nodes have no CPUs to run on.
+    if (not cpus.empty()) {
+      nodes.push_back(std::move(cpus));
+    }
+  }
+  return nodes;
+}
+
+bool pin_thread(const std::vector<unsigned> &cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (auto cpu : cpus) {
+    if (cpu < CPU_SETSIZE) {
+      CPU_SET(cpu, &set);
+    }
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+} // namespace otb
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vector>
+
+namespace otb {
+
+// CPUs of each online NUMA node, as listed by sysfs. Empty when the system does not expose its nodes.
+std::vector<std::vector<unsigned>> numa_nodes();
+
+// Restricts the calling thread to the given CPUs. Returns false when the kernel refuses, e.g. for CPUs outside the process' cpuset.
+bool pin_thread(const std::vector<unsigned> &cpus);
+
+} // namespace otb
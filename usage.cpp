@@ -0,0 +1,46 @@
+#include "otbi.h"
+#include "otbm.h"
+
+#include <fmt/format.h>
+#include <string_view>
+
+namespace {
+
+void print(std::string_view name, size_t bytes, size_t total) {
+  fmt::print("  {:<18s} {:12d} bytes {:5.1f}%\n", name, bytes, total ? 100.0 * static_cast<double>(bytes) / static_cast<double>(total) : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fmt::print("usage: {:s} <items.otb> <map.otbm>\n", argv[0]);
+    return 2;
+  }
+
+  auto items = otbi::load(argv[1]);
+  auto options = otbm::LoadOptions{};
+  options.index_types = true;
+  auto map = otbm::load(argv[2], items, options);
+
+  auto item_usage = otbi::memory_usage(items);
+  fmt::print("items ({:d} types): {:d} bytes\n", items.size(), item_usage.total());
+  print("item types", item_usage.item_types, item_usage.total());
+  print("strings", item_usage.strings, item_usage.total());
+  print("lookup tables", item_usage.lookup_tables, item_usage.total());
+  print("table slack", item_usage.table_slack, item_usage.total());
+
+  auto map_usage = map.memory_usage();
+  fmt::print("map ({:d} tiles): {:d} bytes\n", map.tiles().size(), map_usage.total());
+  print("tile table", map_usage.tile_table, map_usage.total());
+  print("items", map_usage.items, map_usage.total());
+  print("container items", map_usage.container_items, map_usage.total());
+  print("container slack", map_usage.container_slack, map_usage.total());
+  print("strings", map_usage.strings, map_usage.total());
+  print("custom attributes", map_usage.custom_attributes, map_usage.total());
+  print("towns", map_usage.towns, map_usage.total());
+  print("waypoints", map_usage.waypoints, map_usage.total());
+  print("table slack", map_usage.table_slack, map_usage.total());
+  print("type index", map_usage.type_index, map_usage.total());
+  return 0;
+}
@@ -0,0 +1,30 @@
+#include "otbi.h"
+#include "validation.h"
+
+#include <cstdlib>
+#include <fmt/format.h>
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fmt::print("usage: {:s} <items.otb> <map.otbm> [threads]\n", argv[0]);
+    return 2;
+  }
+
+  auto threads = argc > 3 ? static_cast<unsigned>(std::strtoul(argv[3], nullptr, 10)) : 0u;
+  auto items = otbi::load(argv[1]);
+  auto errors = otbm::validate(argv[2], items, threads);
+
+  size_t warnings = 0;
+  for (const auto &error : errors) {
+    auto kind = error.warning ? "warning: " : "";
+    warnings += error.warning;
+    if (error.coords) {
+      fmt::print("{:#010x} ({:d}, {:d}, {:d}): {:s}{:s}\n", error.offset, error.coords->x, error.coords->y, error.coords->z, kind, error.message);
+    } else {
+      fmt::print("{:#010x}: {:s}{:s}\n", error.offset, kind, error.message);
+    }
+  }
+
+  fmt::print("{:s}: {:d} error(s), {:d} warning(s).\n", argv[2], errors.size() - warnings, warnings);
+  return errors.size() == warnings ? 0 : 1;
+}
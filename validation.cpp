@@ -0,0 +1,213 @@
+#include "validation.h"
+#include "attributes.h"
+#include "otbm.h"
+#include "parallel.h"
+#include "stream.h"
+
+#include <fmt/format.h>
+#include <optional>
+#include <stdexcept>
+
+namespace otbm {
+
+namespace {
+
+struct Context {
+  const char *data;
+  const otbi::Items &items;
+  uint16_t width;
+  uint16_t height;
+};
+
+class Report {
+public:
+  Report(const Context &context, std::vector<ValidationError> &errors) : context{context}, errors{errors} {}
+
+  void operator()(otb::iterator at, std::optional<Coords> coords, std::string message) { add(at, coords, std::move(message), false); }
+  void warn(otb::iterator at, std::optional<Coords> coords, std::string message) { add(at, coords, std::move(message), true); }
+
+private:
+  void add(otb::iterator at, std::optional<Coords> coords, std::string message, bool warning) {
+    errors.push_back({static_cast<size_t>(at - context.data), coords, std::move(message), warning});
+  }
+
+  const Context &context;
+  std::vector<ValidationError> &errors;
+};
+
+// Turns what a lenient load reports about a tile area into errors, and into warnings for what it loads anyway.
+class AreaDiagnostics final : public otb::DiagnosticSink {
+public:
+  AreaDiagnostics(const Context &context, Report &out) : context{context}, out{out} {}
+
+  void report(const otb::Diagnostic &diagnostic) override {
+    auto at = context.data + diagnostic.offset;
+    switch (diagnostic.code) {
+    case otb::Warning::SKIPPED_TILE:
+    case otb::Warning::SKIPPED_TILE_AREA:
+      out(at, diagnostic.coords,
+          fmt::format("{:s} not loaded: {:s} (attribute {:d}, ID {:d}).", diagnostic.code == otb::Warning::SKIPPED_TILE ? "Tile" : "Tile area",
+                      otb::describe(static_cast<otb::DecodeError>(diagnostic.value)), diagnostic.attribute, diagnostic.item_id));
+      break;
+
+    case otb::Warning::UNKNOWN_ITEM_ATTRIBUTE:
+      out.warn(at, diagnostic.coords,
+               fmt::format("Unknown item attribute {:d} (ID {:d}), the rest of the item is not loaded.", diagnostic.attribute, diagnostic.item_id));
+      break;
+
+    default:
+      break;
+    }
+  }
+
+private:
+  const Context &context;
+  Report &out;
+};
+
+// Decodes the area as a load would, then checks what a load takes as it is: the floor and the positions of its tiles.
+void check_tile_area(const otb::node &area, const Context &context, Report &report) {
+  auto first = area.props_begin;
+  auto base = Coords{};
+  if (try_read_coords(first, area.props_end, base) and base.z >= MAP_MAX_LAYERS) {
+    report.warn(area.props_begin, base, fmt::format("Invalid floor {:d}, the area is not loaded.", base.z));
+    return;
+  }
+
+  auto diagnostics = AreaDiagnostics{context, report};
+  otbm::check_tile_area(area, context.data, context.items, diagnostics, [&](const otb::node &tile_node, const Coords &coords) {
+    if (coords.x < base.x or coords.y < base.y) {
+      report.warn(tile_node.props_begin, coords, "Tile position overflows, the tile is loaded at the wrapped position.");
+    } else if (coords.x >= context.width or coords.y >= context.height) {
+      report.warn(tile_node.props_begin, coords, fmt::format("Tile outside of the {:d}x{:d} map.", context.width, context.height));
+    }
+  });
+}
+
+template <class F> void check_children(const otb::node &node, int type, std::string_view name, Report &report, F &&check) {
+  for (const auto &child : node.children) {
+    auto first = child.props_begin;
+    if (child.type != type) {
+      report(first - 1, {}, fmt::format("Unknown {:s} node {:d}.", name, child.type));
+      continue;
+    }
+
+    try {
+      check(first, child.props_end);
+    } catch (const std::invalid_argument &e) {
+      report(first, {}, e.what());
+    }
+  }
+}
+
+} // namespace
+
+std::vector<ValidationError> validate(std::string_view filename, const otbi::Items &items, unsigned threads) {
+  std::vector<ValidationError> errors;
+
+  auto file = otb::File{std::string{filename}};
+  auto context = Context{file.data(), items, 0, 0};
+  auto report = Report{context, errors};
+  auto first = otb::iterator{};
+  try {
+    first = otb::check_header(file, "OTBM");
+  } catch (const std::invalid_argument &e) {
+    report(file.begin(), {}, e.what());
+    return errors;
+  }
+  auto root = std::optional<otb::node>{};
+  try {
+    root = otb::parse_node(first, file.end());
+  } catch (const std::invalid_argument &e) {
+    report(first, {}, e.what());
+    return errors;
+  }
+  if (first != file.end()) {
+    report.warn(first, {}, "Data after the root node.");
+  }
+  // Moving the file keeps its contents where they are, so the tree stays valid.
+  auto loader = otb::OTB{std::move(file), std::move(*root)};
+
+  first = loader.begin();
+  auto last = loader.end();
+  uint32_t version = 0;
+  try {
+    version = read<uint32_t>(first, last);
+    if (version == 0 or version > 2) {
+      report(loader.begin(), {}, fmt::format("Unsupported OTBM version {:d}.", version));
+    }
+    context.width = read<uint16_t>(first, last);
+    context.height = read<uint16_t>(first, last);
+  } catch (const std::invalid_argument &e) {
+    report(first, {}, e.what());
+    return errors;
+  }
+
+  if (loader.children().size() != 1 or loader.children().front().type != NODETYPE_MAP_DATA) {
+    report(loader.end(), {}, "Could not read data node.");
+    return errors;
+  }
+
+  const auto &map_node = loader.children().front();
+  first = map_node.props_begin;
+  try {
+    while (first != map_node.props_end) {
+      auto attr_at = first;
+      auto attr = read<uint8_t>(first, map_node.props_end);
+      if (attr != ATTR_DESCRIPTION and attr != ATTR_EXT_SPAWN_FILE and attr != ATTR_EXT_HOUSE_FILE) {
+        report(attr_at, {}, fmt::format("Unknown map attribute {:d}.", attr));
+        break;
+      }
+      skip(first, map_node.props_end, read<uint16_t>(first, map_node.props_end));
+    }
+  } catch (const std::invalid_argument &e) {
+    report(first, {}, e.what());
+  }
+
+  std::vector<const otb::node *> areas;
+  for (const auto &node : map_node.children) {
+    switch (node.type) {
+    case NODETYPE_TILE_AREA:
+      areas.push_back(&node);
+      break;
+
+    case NODETYPE_TOWNS:
+      check_children(node, NODETYPE_TOWN, "town", report, [](otb::iterator &first, const otb::iterator &last) {
+        read<uint32_t>(first, last);
+        skip(first, last, read<uint16_t>(first, last));
+        read_coords(first, last);
+      });
+      break;
+
+    case NODETYPE_WAYPOINTS:
+      // Waypoints came with version 2, the loader does not expect them before.
+      if (version < 2) {
+        report(node.props_begin - 1, {}, fmt::format("Unknown map node {:d}.", node.type));
+        break;
+      }
+      check_children(node, NODETYPE_WAYPOINT, "waypoint", report, [](otb::iterator &first, const otb::iterator &last) {
+        skip(first, last, read<uint16_t>(first, last));
+        read_coords(first, last);
+      });
+      break;
+
+    default:
+      report(node.props_begin - 1, {}, fmt::format("Unknown map node {:d}.", node.type));
+      break;
+    }
+  }
+
+  std::vector<std::vector<ValidationError>> area_errors(areas.size());
+  otb::parallel_for(areas.size(), threads, [&](size_t i) {
+    auto area_report = Report{context, area_errors[i]};
+    check_tile_area(*areas[i], context, area_report);
+  });
+
+  for (auto &errors_in_area : area_errors) {
+    errors.insert(errors.end(), std::make_move_iterator(errors_in_area.begin()), std::make_move_iterator(errors_in_area.end()));
+  }
+  std::stable_sort(errors.begin(), errors.end(), [](const auto &lhs, const auto &rhs) { return lhs.offset < rhs.offset; });
+  return errors;
+}
+
+} // namespace otbm
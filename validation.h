@@ -0,0 +1,28 @@
+#pragma once
+
+#include "coords.h"
+#include "otbi.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace otbm {
+
+struct ValidationError {
+  size_t offset;
+  // Position of the tile the error belongs to, when there is one.
+  std::optional<Coords> coords;
+  std::string message;
+  // Something a load accepts but likely not meant, such as a tile outside the map bounds or an item attribute the load stops reading at.
+  bool warning = false;
+};
+
+// Checks a map without building it: node nesting, node types and attributes, then every tile area decoded as load() would decode it, items
+// looked up in `items`, and tile coordinates against the map bounds. Tile areas are checked in parallel on up to `threads` threads (0 uses
+// every hardware thread). Errors are returned sorted by byte offset; a result without errors, warnings aside, means the map loads.
+std::vector<ValidationError> validate(std::string_view filename, const otbi::Items &items, unsigned threads = 0);
+
+} // namespace otbm
@@ -0,0 +1,181 @@
+#include "wire.h"
+#include "memory.h"
+
+#include <algorithm>
+#include <array>
+
+namespace otbm {
+
+namespace {
+
+constexpr uint8_t EMPTY_TILE = 0;
+
+// The client color of each of the 8 server fluid colors, which a fluid type is plus a multiple of 8: water is blue, life fluid red + 8, lava
+// red + 24. Clients number their colors in another order, so they are sent these instead.
+constexpr std::array<uint8_t, 8> CLIENT_FLUIDS = {
+    0, // empty
+    1, // blue
+    5, // red
+    3, // brown
+    6, // green
+    8, // yellow
+    9, // white
+    2, // purple
+};
+
+void describe_item(const otb::Item &item, std::vector<uint8_t> &out) {
+  auto id = item.type->client_id();
+  out.push_back(static_cast<uint8_t>(id));
+  out.push_back(static_cast<uint8_t>(id >> 8));
+  if (item.type->stackable()) {
+    out.push_back(static_cast<uint8_t>(std::clamp<uint16_t>(item.count, 1, 0xFF)));
+  } else if (item.type->is_fluid_container() or item.type->is_splash()) {
+    out.push_back(CLIENT_FLUIDS[item.fluid_type & 7]);
+  }
+}
+
+} // namespace
+
+void describe_tile(const Tile &tile, std::vector<uint8_t> &out) {
+  auto count_at = out.size();
+  out.push_back(0);
+
+  uint8_t count = 0;
+  auto add = [&](const otb::Item &item) {
+    if (count < MAX_TILE_THINGS and item.type->client_id() != 0) {
+      describe_item(item, out);
+      ++count;
+    }
+  };
+
+  if (tile.ground()) {
+    add(*tile.ground());
+  }
+  // A tile holds few items always on top, so they are taken one order at a time rather than sorted.
+  auto previous = -1;
+  while (true) {
+    auto order = 0x100;
+    for (const auto &item : tile.items()) {
+      if (item.type->always_on_top() and item.type->always_on_top_order() > previous) {
+        order = std::min<int>(order, item.type->always_on_top_order());
+      }
+    }
+    if (order == 0x100) {
+      break;
+    }
+    for (const auto &item : tile.items()) {
+      if (item.type->always_on_top() and item.type->always_on_top_order() == order) {
+        add(item);
+      }
+    }
+    previous = order;
+  }
+  // Every other item is placed above those before it, so the last one in the map is the first sent.
+  for (auto it = tile.items().rbegin(); it != tile.items().rend(); ++it) {
+    if (not it->type->always_on_top()) {
+      add(*it);
+    }
+  }
+  out[count_at] = count;
+}
+
+TileDescriptions::TileDescriptions(const Map &map) {
+  // A sector is written front to back, so its tiles are gathered and put in order first.
+  tsl::robin_map<uint32_t, std::vector<std::pair<uint16_t, const Tile *>>> pending;
+  for (const auto &[coords, tile] : map.tiles()) {
+    pending[Grid::key(coords.x, coords.y, coords.z)].emplace_back(static_cast<uint16_t>(index(coords.x, coords.y)), &tile);
+  }
+
+  sectors.reserve(pending.size());
+  for (auto it = pending.begin(); it != pending.end(); ++it) {
+    auto &tiles = it.value();
+    std::sort(tiles.begin(), tiles.end(), [](const auto &lhs, const auto &rhs) { return lhs.first < rhs.first; });
+
+    auto &sector = sectors[it->first];
+    auto next = tiles.begin();
+    for (size_t i = 0; i < SECTOR_TILES; ++i) {
+      sector.offsets[i] = static_cast<uint32_t>(sector.bytes.size());
+      if (next != tiles.end() and next->first == i) {
+        describe_tile(*next->second, sector.bytes);
+        ++next;
+      } else {
+        sector.bytes.push_back(EMPTY_TILE);
+      }
+    }
+    sector.offsets[SECTOR_TILES] = static_cast<uint32_t>(sector.bytes.size());
+    sector.bytes.shrink_to_fit();
+  }
+}
+
+otb::Span<const uint8_t> TileDescriptions::describe(const Coords &coords) const {
+  auto it = sectors.find(Grid::key(coords.x, coords.y, coords.z));
+  if (it == sectors.end()) {
+    return {&EMPTY_TILE, 1};
+  }
+  const auto &sector = it->second;
+  auto i = index(coords.x, coords.y);
+  return {sector.bytes.data() + sector.offsets[i], sector.offsets[i + 1] - sector.offsets[i]};
+}
+
+void TileDescriptions::describe(const Rect &area, uint8_t z, std::vector<uint8_t> &out) const {
+  for (uint32_t y = area.y0; y <= area.y1; ++y) {
+    for (uint32_t x = area.x0; x <= area.x1;) {
+      // The part of this row inside the sector holding (x, y).
+      auto last = std::min<uint32_t>(x | Grid::SECTOR_MASK, area.x1);
+      auto it = sectors.find(Grid::key(static_cast<uint16_t>(x), static_cast<uint16_t>(y), z));
+      if (it == sectors.end()) {
+        out.insert(out.end(), last - x + 1, EMPTY_TILE);
+      } else {
+        const auto &sector = it->second;
+        auto first_tile = index(static_cast<uint16_t>(x), static_cast<uint16_t>(y));
+        auto last_tile = index(static_cast<uint16_t>(last), static_cast<uint16_t>(y));
+        out.insert(out.end(), sector.bytes.begin() + sector.offsets[first_tile], sector.bytes.begin() + sector.offsets[last_tile + 1]);
+      }
+      x = last + 1;
+    }
+  }
+}
+
+void TileDescriptions::update(const Coords &coords, const Tile *tile) {
+  auto key = Grid::key(coords.x, coords.y, coords.z);
+  auto it = sectors.find(key);
+  if (it == sectors.end()) {
+    if (not tile) {
+      return;
+    }
+    it = sectors.emplace(key, Sector{}).first;
+    auto &sector = it.value();
+    sector.bytes.assign(SECTOR_TILES, EMPTY_TILE);
+    for (uint32_t i = 0; i <= SECTOR_TILES; ++i) {
+      sector.offsets[i] = i;
+    }
+  }
+
+  std::vector<uint8_t> description;
+  if (tile) {
+    describe_tile(*tile, description);
+  } else {
+    description.push_back(EMPTY_TILE);
+  }
+
+  auto &sector = it.value();
+  auto i = index(coords.x, coords.y);
+  auto first = sector.bytes.begin() + sector.offsets[i];
+  auto last = sector.bytes.begin() + sector.offsets[i + 1];
+  sector.bytes.insert(sector.bytes.erase(first, last), description.begin(), description.end());
+
+  auto delta = static_cast<int64_t>(description.size()) - (int64_t{sector.offsets[i + 1]} - sector.offsets[i]);
+  for (auto j = i + 1; j <= SECTOR_TILES; ++j) {
+    sector.offsets[j] = static_cast<uint32_t>(sector.offsets[j] + delta);
+  }
+}
+
+size_t TileDescriptions::memory_usage() const {
+  auto bytes = otb::memory::used_buckets(sectors) + otb::memory::empty_buckets(sectors);
+  for (const auto &[key, sector] : sectors) {
+    bytes += sector.bytes.capacity();
+  }
+  return bytes;
+}
+
+} // namespace otbm
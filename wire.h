@@ -0,0 +1,55 @@
+#pragma once
+
+#include "coords.h"
+#include "grid.h"
+#include "otbm.h"
+
+#include <array>
+#include <cstdint>
+#include <tsl/robin_map.h>
+#include <vector>
+
+namespace otbm {
+
+// Clients show at most this many things on a tile.
+constexpr auto MAX_TILE_THINGS = 10;
+
+// Appends what clients are sent of a tile: a byte with the number of things, then each thing in the order of the stack a client keeps. That is
+// the ground, the items always on top by their order, then the other items with the last one placed first. A thing is its client id, 2 bytes
+// little-endian, followed by a byte with the count of stackables or the client color of the fluid in fluid containers and splashes. Items
+// without a client id are left out.
+void describe_tile(const Tile &tile, std::vector<uint8_t> &out);
+
+// Descriptions of the tiles of a map as made by describe_tile, kept contiguous per sector of the grid with its positions row after row. The
+// description of an area is then one copy per sector row it crosses. Positions without a tile are described as empty, a single 0 byte.
+// Queries only read, so any number of threads may run them concurrently; update() needs the descriptions to itself.
+class TileDescriptions {
+public:
+  explicit TileDescriptions(const Map &map);
+
+  // Description of the tile at `coords`, valid until the next update().
+  otb::Span<const uint8_t> describe(const Coords &coords) const;
+  // Appends the descriptions of every position of `area` on floor `z`, row after row from west to east.
+  void describe(const Rect &area, uint8_t z, std::vector<uint8_t> &out) const;
+
+  // Describes the tile at `coords` anew after it changed, or as empty for null. Only that tile is encoded; the rest of its sector is moved.
+  void update(const Coords &coords, const Tile *tile);
+
+  // Bytes held by the descriptions and their offsets.
+  size_t memory_usage() const;
+
+private:
+  static constexpr auto SECTOR_TILES = Grid::SECTOR_SIZE * Grid::SECTOR_SIZE;
+
+  struct Sector {
+    std::vector<uint8_t> bytes = {};
+    // Where the description of each position starts in `bytes`, with the end of the last one.
+    std::array<uint32_t, SECTOR_TILES + 1> offsets = {};
+  };
+
+  static constexpr size_t index(uint16_t x, uint16_t y) { return static_cast<size_t>((y & Grid::SECTOR_MASK) * Grid::SECTOR_SIZE + (x & Grid::SECTOR_MASK)); }
+
+  tsl::robin_map<uint32_t, Sector> sectors = {};
+};
+
+} // namespace otbm